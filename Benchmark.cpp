@@ -0,0 +1,400 @@
+//--------------------------------------------------------------------------------------
+// Benchmark.cpp
+// Micro benchmarks for the hot paths in the USHCN code
+// Usage : bench.exe [USHCN_FILE_NAME]
+// Without a file name synthetic daily, v2 and v2.5 archives are generated in memory
+
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "USHCN.h"
+#include "Kernels.h"
+#include "RecordSource.h"
+
+// Results are folded into here so the optimiser can't drop the work
+volatile float benchmark_sink = 0.0f;
+
+static double
+secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The parser as it was before the fixed width decoder, kept as a baseline
+static float
+legacyParseTemperatureRecord(std::string record_string)
+{
+    if (record_string.length() < 261)
+    {
+        return 0.0f;
+    }
+
+    float checksum = 0.0f;
+    checksum += strtoul( record_string.substr(0, 6).c_str(), NULL, 10 );
+    checksum += strtoul( record_string.substr(0, 2).c_str(), NULL, 10 );
+    checksum += strtoul( record_string.substr(6, 4).c_str(), NULL, 10 );
+    checksum += strtoul( record_string.substr(10, 2).c_str(), NULL, 10 );
+    std::string record_type = record_string.substr(12, 4);
+    size_t position = 16;
+
+    for (size_t i = 0; i < MAX_DAYS_IN_MONTH; i++)
+    {
+        std::string value_string =  record_string.substr(position, 5);
+        long value = strtol( value_string.c_str(), NULL, 10 );
+
+        if ( record_type == "TMIN" || record_type == "TMAX" )
+        {
+            checksum += (value == -9999) ? UNKNOWN_TEMPERATURE : float(value);
+        }
+
+        position += 8;
+    }
+
+    return checksum;
+}
+
+static std::vector<std::string>
+makeSyntheticDailyRecords(size_t number_of_lines)
+{
+    static const char* elements[] = { "TMAX", "TMIN", "PRCP", "SNOW", "SNWD" };
+    std::vector<std::string> lines;
+    lines.reserve(number_of_lines);
+    unsigned int seed = 12345;
+
+    for (size_t i = 0; i < number_of_lines; i++)
+    {
+        char buffer[512];
+        int length = snprintf(buffer, sizeof(buffer), "%06u%04u%02u%s", 11084 + unsigned(i / 6000), 1900 + unsigned(i / 60) % 114, unsigned(i / 5) % 12 + 1, elements[i % 5]);
+
+        for (size_t day = 0; day < MAX_DAYS_IN_MONTH; day++)
+        {
+            seed = seed * 1103515245 + 12345;
+            int value = (seed >> 16) % 23 == 0 ? -9999 : int( (seed >> 16) % 120 ) - 20;
+            length += snprintf(buffer + length, sizeof(buffer) - length, "%5d   ", value);
+        }
+
+        lines.push_back( std::string(buffer, length) );
+    }
+
+    return lines;
+}
+
+// Monthly archive lines in either the v2 or the v2.5 layout
+static std::vector<std::string>
+makeSyntheticMonthlyRecords(size_t number_of_lines, bool version_2_5)
+{
+    std::vector<std::string> lines;
+    lines.reserve(number_of_lines);
+    unsigned int seed = 6789;
+
+    for (size_t i = 0; i < number_of_lines; i++)
+    {
+        char buffer[256];
+        unsigned int station = 11084 + unsigned(i / 120);
+        unsigned int year = 1895 + unsigned(i % 120);
+        int length = version_2_5 ? snprintf(buffer, sizeof(buffer), "USH00%06u %04u", station, year)
+                                 : snprintf(buffer, sizeof(buffer), "%06u3%04u", station, year);
+
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            seed = seed * 1103515245 + 12345;
+            int value = (seed >> 16) % 31 == 0 ? -9999 : int( (seed >> 16) % 3000 ) - 500;
+            const char* flag = (seed >> 20) % 4 == 0 ? "E  " : "   ";
+            length += version_2_5 ? snprintf(buffer + length, sizeof(buffer) - length, "%6d%s", value, flag)
+                                  : snprintf(buffer + length, sizeof(buffer) - length, " %5d ", value / 3);
+        }
+
+        lines.push_back( std::string(buffer, length) );
+    }
+
+    return lines;
+}
+
+// Decode lines with whichever registered source claims them
+static void
+benchmarkRecordSource(const std::vector<std::string>& lines)
+{
+    std::string sample;
+
+    for (size_t i = 0; i < lines.size() && sample.size() < RECORD_SOURCE_PROBE_SIZE; i++)
+    {
+        sample += lines[i] + "\n";
+    }
+
+    const RecordSource* source = detectRecordSource( sample.data(), sample.size() );
+
+    if (source == NULL)
+    {
+        std::cout << "  no decoder for sample starting " << lines[0].substr(0, 16) << std::endl;
+        return;
+    }
+
+    size_t repeats = lines.size() < 1000000 ? 1000000 / lines.size() + 1 : 1;
+    double total_bytes = 0.0;
+    DataRecord daily_record;
+    MonthlyRecord monthly_record;
+    float checksum = 0.0f;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t r = 0; r < repeats; r++)
+    {
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            total_bytes += double( lines[i].length() + 1 );
+
+            if ( source->isDaily() )
+            {
+                if ( source->decodeDaily( lines[i].data(), lines[i].length(), daily_record ) )
+                {
+                    checksum += daily_record.getHighTemperature(0);
+                }
+            }
+            else if ( source->decodeMonthly( lines[i].data(), lines[i].length(), monthly_record ) )
+            {
+                checksum += monthly_record.getTemperature(0);
+            }
+        }
+    }
+
+    double seconds = secondsSince(start);
+
+    std::cout << "  " << std::setw(15) << std::left << source->getName() << ": " << total_bytes / seconds / 1.0e6 << " MB/s" << std::endl;
+    benchmark_sink = checksum;
+}
+
+static void
+benchmarkDailyRecordParser(const std::vector<std::string>& lines)
+{
+    size_t repeats = lines.size() < 1000000 ? 1000000 / lines.size() + 1 : 1;
+    double total_lines = double(lines.size()) * double(repeats);
+
+    float legacy_checksum = 0.0f;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t r = 0; r < repeats; r++)
+    {
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            legacy_checksum += legacyParseTemperatureRecord( lines[i] );
+        }
+    }
+
+    double legacy_seconds = secondsSince(start);
+
+    DataRecord record;
+    float checksum = 0.0f;
+    start = std::chrono::steady_clock::now();
+
+    for (size_t r = 0; r < repeats; r++)
+    {
+        for (size_t i = 0; i < lines.size(); i++)
+        {
+            if ( record.parseTemperatureRecord( lines[i].data(), lines[i].length() ) )
+            {
+                checksum += record.getHighTemperature(0) + record.getLowTemperature(MAX_DAYS_IN_MONTH - 1);
+            }
+        }
+    }
+
+    double seconds = secondsSince(start);
+
+    std::cout << "parseTemperatureRecord" << std::endl;
+    std::cout << "  substr/strtol  : " << total_lines / legacy_seconds << " lines/s" << std::endl;
+    std::cout << "  fixed width    : " << total_lines / seconds << " lines/s" << std::endl;
+    std::cout << "  speedup        : " << legacy_seconds / seconds << "x" << std::endl;
+    benchmark_sink = legacy_checksum + checksum;
+}
+
+// Runs one station's worth of years through a pair of block kernels
+static uint32_t
+scanStationYears(std::vector<float>& max_temperatures, std::vector<float>& min_temperatures, size_t number_of_years,
+                 ScanBlockFunction scan_max_block, ScanBlockFunction scan_min_block, float& sum)
+{
+    float record_max_temperatures[NUMBER_OF_MONTHS_PER_YEAR][MAX_DAYS_IN_MONTH];
+    float record_min_temperatures[NUMBER_OF_MONTHS_PER_YEAR][MAX_DAYS_IN_MONTH];
+    uint32_t checksum = 0;
+
+    for (size_t i = 0; i < NUMBER_OF_MONTHS_PER_YEAR; i++)
+    {
+        for (size_t j = 0; j < MAX_DAYS_IN_MONTH; j++)
+        {
+            record_max_temperatures[i][j] = float(INT_MIN);
+            record_min_temperatures[i][j] = float(INT_MAX);
+        }
+    }
+
+    for (size_t year_index = 0; year_index < number_of_years; year_index++)
+    {
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            size_t slot = DailyColumns::getSlot(year_index, month, 0);
+            BlockScan max_scan;
+            BlockScan min_scan;
+            scan_max_block(&max_temperatures[slot], record_max_temperatures[month], max_scan);
+            scan_min_block(&min_temperatures[slot], record_min_temperatures[month], min_scan);
+            sum += max_scan.sum + min_scan.sum;
+            checksum = (checksum * 31) ^ max_scan.valid_mask ^ max_scan.greater_mask ^ (max_scan.equal_mask << 1);
+            checksum = (checksum * 31) ^ min_scan.valid_mask ^ min_scan.greater_mask ^ (min_scan.equal_mask << 1);
+        }
+    }
+
+    return checksum;
+}
+
+static void
+benchmarkBlockKernels()
+{
+    const size_t number_of_years = 120;
+    const size_t number_of_stations = 200;
+    size_t number_of_slots = number_of_years * DailyColumns::SLOTS_PER_YEAR;
+    std::vector<float> max_temperatures(number_of_slots);
+    std::vector<float> min_temperatures(number_of_slots);
+    unsigned int seed = 4321;
+
+    for (size_t i = 0; i < number_of_slots; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        max_temperatures[i] = (seed >> 16) % 29 == 0 ? UNKNOWN_TEMPERATURE : float( 40 + (seed >> 16) % 60 );
+        seed = seed * 1103515245 + 12345;
+        min_temperatures[i] = (seed >> 16) % 29 == 0 ? UNKNOWN_TEMPERATURE : float( -10 + (seed >> 16) % 60 );
+    }
+
+    double station_years = double(number_of_years) * double(number_of_stations);
+    float scalar_sum = 0.0f;
+    uint32_t scalar_checksum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t station = 0; station < number_of_stations; station++)
+    {
+        scalar_checksum ^= scanStationYears(max_temperatures, min_temperatures, number_of_years, scanMaxBlockScalar, scanMinBlockScalar, scalar_sum);
+    }
+
+    double scalar_seconds = secondsSince(start);
+    float sum = 0.0f;
+    uint32_t checksum = 0;
+    start = std::chrono::steady_clock::now();
+
+    for (size_t station = 0; station < number_of_stations; station++)
+    {
+        checksum ^= scanStationYears(max_temperatures, min_temperatures, number_of_years, scanMaxBlock, scanMinBlock, sum);
+    }
+
+    double seconds = secondsSince(start);
+
+    std::cout << "scanMaxBlock/scanMinBlock" << std::endl;
+    std::cout << "  scalar         : " << station_years / scalar_seconds << " station-years/s" << std::endl;
+    std::cout << "  " << std::setw(15) << std::left << getKernelName() << ": " << station_years / seconds << " station-years/s" << std::endl;
+    std::cout << "  speedup        : " << scalar_seconds / seconds << "x" << std::endl;
+    std::cout << "  results match  : " << ( (checksum == scalar_checksum && sum == scalar_sum) ? "yes" : "NO" ) << std::endl;
+    benchmark_sink = sum;
+}
+
+// Sums readings forwards and backwards into Accumulator, returning whether
+// both orders gave the same bits
+template <typename Accumulator>
+static bool
+sumBothWays(const std::vector<float>& readings, size_t repeats, double& seconds, float& sum)
+{
+    Accumulator forward_sum = Accumulator();
+    Accumulator backward_sum = Accumulator();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t r = 0; r < repeats; r++)
+    {
+        for (size_t i = 0; i < readings.size(); i++)
+        {
+            forward_sum += readings[i];
+        }
+    }
+
+    seconds = secondsSince(start);
+
+    for (size_t r = 0; r < repeats; r++)
+    {
+        for (size_t i = readings.size(); i > 0; i--)
+        {
+            backward_sum += readings[i - 1];
+        }
+    }
+
+    sum = float(forward_sum);
+    return forward_sum == backward_sum;
+}
+
+static void
+benchmarkAccumulators()
+{
+    // Monthly v2.5 style readings, hundredths of a degree F
+    const size_t number_of_readings = 1000000;
+    const size_t repeats = 20;
+    std::vector<float> readings(number_of_readings);
+    unsigned int seed = 2468;
+
+    for (size_t i = 0; i < number_of_readings; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        readings[i] = float( int( (seed >> 16) % 3000 ) - 500 ) * 0.018f + 32.0f;
+    }
+
+    double total_readings = double(number_of_readings) * double(repeats);
+    double float_seconds;
+    double double_seconds;
+    double exact_seconds;
+    float float_sum;
+    float double_sum;
+    float exact_sum;
+    bool float_same = sumBothWays<float>(readings, repeats, float_seconds, float_sum);
+    bool double_same = sumBothWays<double>(readings, repeats, double_seconds, double_sum);
+    bool exact_same = sumBothWays<ExactSum>(readings, repeats, exact_seconds, exact_sum);
+
+    std::cout << "Accumulators, " << total_readings << " readings" << std::endl;
+    std::cout << "  float          : " << total_readings / float_seconds << " readings/s, sum " << float_sum
+              << ", order independent " << (float_same ? "yes" : "no") << std::endl;
+    std::cout << "  double         : " << total_readings / double_seconds << " readings/s, sum " << double_sum
+              << ", order independent " << (double_same ? "yes" : "no") << std::endl;
+    std::cout << "  ExactSum       : " << total_readings / exact_seconds << " readings/s, sum " << exact_sum
+              << ", order independent " << (exact_same ? "yes" : "no") << std::endl;
+    std::cout << "  cost vs float  : " << exact_seconds / float_seconds << "x" << std::endl;
+    benchmark_sink = float_sum + double_sum + exact_sum;
+}
+
+int main (int argc, char** argv)
+{
+    std::vector<std::string> lines;
+
+    if (argc > 1)
+    {
+        std::ifstream ushcn_data_file(argv[1]);
+        std::string record_string;
+
+        while ( getline(ushcn_data_file, record_string) )
+        {
+            lines.push_back(record_string);
+        }
+    }
+
+    if ( lines.empty() )
+    {
+        lines = makeSyntheticDailyRecords(200000);
+    }
+
+    benchmarkDailyRecordParser(lines);
+    benchmarkBlockKernels();
+    benchmarkAccumulators();
+
+    std::cout << "RecordSource decoders" << std::endl;
+    benchmarkRecordSource(lines);
+
+    if (argc <= 1)
+    {
+        benchmarkRecordSource( makeSyntheticMonthlyRecords(100000, false) );
+        benchmarkRecordSource( makeSyntheticMonthlyRecords(100000, true) );
+    }
+
+    return 0;
+}
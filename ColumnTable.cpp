@@ -0,0 +1,119 @@
+//--------------------------------------------------------------------------------------
+// ColumnTable.cpp
+// Typed columnar tables for out=, see ColumnTable.h for the layout.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ColumnTable.h"
+
+static const char           COLUMN_TABLE_MAGIC[8] = { 'U', 'S', 'H', 'C', 'N', 'C', 'O', 'L' };
+static const size_t         COLUMN_TABLE_HEADER_SIZE = 24;
+static const size_t         COLUMN_DESCRIPTOR_SIZE = 40;
+
+static void
+appendLittleEndian(std::vector<char>& buffer, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        buffer.push_back( char( (value >> (8 * i)) & 0xff ) );
+    }
+}
+
+size_t
+ColumnTable::addColumn(const std::string& name, ColumnType type)
+{
+    Column column;
+    column.name = name.substr(0, MAX_COLUMN_NAME_LENGTH);
+    column.type = type;
+    m_column_vector.push_back(column);
+    return m_column_vector.size() - 1;
+}
+
+void
+ColumnTable::putWord(size_t column, uint32_t value)
+{
+    appendLittleEndian(m_column_vector[column].data, value, sizeof(value));
+}
+
+void
+ColumnTable::putFloat(size_t column, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putWord(column, bits);
+}
+
+void
+ColumnTable::append(const ColumnTable& table)
+{
+    for (size_t i = 0; i < m_column_vector.size() && i < table.m_column_vector.size(); i++)
+    {
+        const std::vector<char>& data = table.m_column_vector[i].data;
+        m_column_vector[i].data.insert( m_column_vector[i].data.end(), data.begin(), data.end() );
+    }
+}
+
+bool
+ColumnTable::write(const std::string& file_name) const
+{
+    size_t number_of_rows = getNumberOfRows();
+    size_t number_of_columns = m_column_vector.size();
+    size_t column_bytes = number_of_rows * sizeof(uint32_t);
+
+    for (size_t i = 0; i < number_of_columns; i++)
+    {
+        if (m_column_vector[i].data.size() != column_bytes)
+        {
+            return false;
+        }
+    }
+
+    std::vector<char> header;
+    header.insert( header.end(), COLUMN_TABLE_MAGIC, COLUMN_TABLE_MAGIC + sizeof(COLUMN_TABLE_MAGIC) );
+    appendLittleEndian(header, COLUMN_TABLE_VERSION, 4);
+    appendLittleEndian(header, number_of_columns, 4);
+    appendLittleEndian(header, number_of_rows, 8);
+
+    // Each column is padded out to the next 8 byte boundary
+    size_t padded_column_bytes = (column_bytes + 7) & ~size_t(7);
+    size_t offset = COLUMN_TABLE_HEADER_SIZE + (number_of_columns * COLUMN_DESCRIPTOR_SIZE);
+
+    for (size_t i = 0; i < number_of_columns; i++)
+    {
+        char name[MAX_COLUMN_NAME_LENGTH + 1];
+        memset(name, 0, sizeof(name));
+        memcpy( name, m_column_vector[i].name.data(), m_column_vector[i].name.size() );
+
+        header.insert(header.end(), name, name + sizeof(name));
+        appendLittleEndian(header, m_column_vector[i].type, 4);
+        appendLittleEndian(header, sizeof(uint32_t), 4);
+        appendLittleEndian(header, offset, 8);
+        offset += padded_column_bytes;
+    }
+
+    std::string temporary_file_name = file_name + ".tmp";
+    FILE* table_file = fopen(temporary_file_name.c_str(), "wb");
+
+    if (table_file == NULL)
+    {
+        return false;
+    }
+
+    static const char padding[8] = { 0 };
+    bool written = fwrite( header.data(), 1, header.size(), table_file ) == header.size();
+
+    for (size_t i = 0; i < number_of_columns && written; i++)
+    {
+        written =    fwrite( m_column_vector[i].data.data(), 1, column_bytes, table_file ) == column_bytes
+                  && fwrite( padding, 1, padded_column_bytes - column_bytes, table_file ) == padded_column_bytes - column_bytes;
+    }
+
+    if ( fclose(table_file) != 0 || !written || rename( temporary_file_name.c_str(), file_name.c_str() ) != 0 )
+    {
+        remove( temporary_file_name.c_str() );
+        return false;
+    }
+
+    return true;
+}
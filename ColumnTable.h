@@ -0,0 +1,79 @@
+//--------------------------------------------------------------------------------------
+// ColumnTable.h
+// Typed columnar tables for out=, so the computed series can be memory
+// mapped instead of scraped out of the text report. Each table is one file:
+//
+// File layout, little endian whatever the host:
+//
+//   offset  size  field
+//        0     8  magic "USHCNCOL"
+//        8     4  uint32 format version (COLUMN_TABLE_VERSION)
+//       12     4  uint32 number of columns C
+//       16     8  uint64 number of rows R
+//       24  C*40  column descriptors:
+//                   24  column name, NUL padded
+//                    4  uint32 ColumnType
+//                    4  uint32 bytes per value
+//                    8  uint64 offset of the column's values from the start of the file
+//        -     -  the columns' values, R each, every column starting on an
+//                 8 byte boundary
+//
+// Floats are IEEE 754 singles. The tables out= writes, and their columns,
+// are listed above ExportTables in Main.cpp.
+
+#ifndef COLUMN_TABLE_H_INCLUDED
+#define COLUMN_TABLE_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+static const uint32_t       COLUMN_TABLE_VERSION = 1;
+
+enum ColumnType
+{
+    COLUMN_INT32 = 1,
+    COLUMN_UINT32 = 2,
+    COLUMN_FLOAT32 = 3
+};
+
+class ColumnTable
+{
+public:
+    static const size_t     MAX_COLUMN_NAME_LENGTH = 23;
+
+    // Columns are added before any rows, and numbered from 0 in the order
+    // they were added
+    size_t                  addColumn(const std::string& name, ColumnType type);
+
+    // A row is one put of the right type into every column
+    void                    putInt(size_t column, int32_t value) { putWord( column, uint32_t(value) ); }
+    void                    putUnsigned(size_t column, uint32_t value) { putWord(column, value); }
+    void                    putFloat(size_t column, float value);
+
+    // Append the rows of a table with the same columns
+    void                    append(const ColumnTable& table);
+
+    size_t                  getNumberOfColumns() const { return m_column_vector.size(); }
+    size_t                  getNumberOfRows() const { return m_column_vector.empty() ? 0 : m_column_vector[0].data.size() / sizeof(uint32_t); }
+
+    // Write the table to file_name through a temporary file, so a reader
+    // never maps half a table. False if it can't be written or a column is
+    // short of rows.
+    bool                    write(const std::string& file_name) const;
+
+private:
+    struct Column
+    {
+        std::string         name;
+        ColumnType          type;
+        std::vector<char>   data;           // already little endian
+    };
+
+    void                    putWord(size_t column, uint32_t value);
+
+    std::vector<Column>     m_column_vector;
+};
+
+#endif // COLUMN_TABLE_H_INCLUDED
@@ -0,0 +1,162 @@
+//--------------------------------------------------------------------------------------
+// GriddedAverage.cpp
+// Area weighted national means for the monthly archives, see GriddedAverage.h
+
+#include <algorithm>
+#include <math.h>
+
+#include "GriddedAverage.h"
+
+static const double         DEGREES_TO_RADIANS = 3.14159265358979323846 / 180.0;
+
+// A station's cell, and its dense id so the sort is stable
+struct GridCellKey
+{
+    int                     row;
+    int                     column;
+    size_t                  station_id;
+
+    bool                    operator<(const GridCellKey& other) const
+                            {
+                                if (row != other.row)
+                                {
+                                    return row < other.row;
+                                }
+
+                                if (column != other.column)
+                                {
+                                    return column < other.column;
+                                }
+
+                                return station_id < other.station_id;
+                            }
+};
+
+void
+GriddedAverage::build(const StationCatalog& catalog, float cell_size_degrees)
+{
+    m_catalog = &catalog;
+    m_column_vector.assign( catalog.size(), 0 );
+    m_cell_start_vector.clear();
+    m_cell_weight_vector.clear();
+    m_first_year = 0;
+    m_number_of_years = 0;
+    m_sum_vector.clear();
+    m_count_vector.clear();
+
+    std::vector<GridCellKey> key_vector( catalog.size() );
+
+    for (size_t station_id = 0; station_id < catalog.size(); station_id++)
+    {
+        key_vector[station_id].row = (int)floor( catalog[station_id].latitude / cell_size_degrees );
+        key_vector[station_id].column = (int)floor( catalog[station_id].longitude / cell_size_degrees );
+        key_vector[station_id].station_id = station_id;
+    }
+
+    std::sort( key_vector.begin(), key_vector.end() );
+
+    for (size_t column = 0; column < key_vector.size(); column++)
+    {
+        if ( column == 0 || key_vector[column].row != key_vector[column - 1].row || key_vector[column].column != key_vector[column - 1].column )
+        {
+            // Centre of the part of the cell that is on the globe
+            double south_edge = std::max( -90.0, double(key_vector[column].row) * cell_size_degrees );
+            double north_edge = std::min( 90.0, double(key_vector[column].row + 1) * cell_size_degrees );
+            double centre_latitude = (south_edge + north_edge) / 2.0;
+            m_cell_start_vector.push_back(column);
+            m_cell_weight_vector.push_back( std::max( 0.0, cos(centre_latitude * DEGREES_TO_RADIANS) ) );
+        }
+
+        m_column_vector[ key_vector[column].station_id ] = (unsigned int)column;
+    }
+
+    m_cell_start_vector.push_back( key_vector.size() );
+}
+
+void
+GriddedAverage::extend(unsigned int year)
+{
+    unsigned int last_year = m_first_year + (unsigned int)m_number_of_years - 1;
+    unsigned int first_year = ( m_number_of_years == 0 || year < m_first_year ) ? year : m_first_year;
+    size_t row_size = NUMBER_OF_MONTHS_PER_YEAR * getNumberOfColumns();
+    size_t shift = (m_number_of_years == 0) ? 0 : (m_first_year - first_year) * row_size;
+
+    last_year = ( m_number_of_years == 0 || year > last_year ) ? year : last_year;
+    m_number_of_years = last_year - first_year + 1;
+    m_first_year = first_year;
+
+    // Earlier years go in at the front, later ones on the end
+    m_sum_vector.insert( m_sum_vector.begin(), shift, 0.0f );
+    m_count_vector.insert( m_count_vector.begin(), shift, 0 );
+    m_sum_vector.resize( m_number_of_years * row_size, 0.0f );
+    m_count_vector.resize( m_number_of_years * row_size, 0 );
+}
+
+bool
+GriddedAverage::add(unsigned int station_number, unsigned int year, size_t month, float temperature)
+{
+    size_t station_id = (m_catalog == NULL) ? StationCatalog::NO_STATION : m_catalog->findId(station_number);
+
+    if ( station_id == StationCatalog::NO_STATION || year >= MAX_YEARS )
+    {
+        return false;
+    }
+
+    if ( m_number_of_years == 0 || year < m_first_year || year - m_first_year >= m_number_of_years )
+    {
+        extend(year);
+    }
+
+    size_t index = ( ( (year - m_first_year) * NUMBER_OF_MONTHS_PER_YEAR ) + month ) * getNumberOfColumns() + m_column_vector[station_id];
+    m_sum_vector[index] += temperature;
+    m_count_vector[index]++;
+    return true;
+}
+
+void
+GriddedAverage::getMonthlyMeans(std::vector<float>& mean_vector, std::vector<unsigned int>& cell_count_vector) const
+{
+    size_t number_of_months = m_number_of_years * NUMBER_OF_MONTHS_PER_YEAR;
+    size_t number_of_columns = getNumberOfColumns();
+    size_t number_of_cells = getNumberOfCells();
+
+    mean_vector.assign(number_of_months, UNKNOWN_TEMPERATURE);
+    cell_count_vector.assign(number_of_months, 0);
+
+    for (size_t month_index = 0; month_index < number_of_months; month_index++)
+    {
+        const float* sum_row = &m_sum_vector[month_index * number_of_columns];
+        const unsigned short* count_row = &m_count_vector[month_index * number_of_columns];
+        double weighted_sum = 0.0;
+        double total_weight = 0.0;
+        unsigned int number_of_cells_reporting = 0;
+
+        for (size_t cell = 0; cell < number_of_cells; cell++)
+        {
+            double cell_sum = 0.0;
+            unsigned int number_of_stations = 0;
+
+            for (size_t column = m_cell_start_vector[cell]; column < m_cell_start_vector[cell + 1]; column++)
+            {
+                if ( count_row[column] )
+                {
+                    cell_sum += double( sum_row[column] ) / double( count_row[column] );
+                    number_of_stations++;
+                }
+            }
+
+            if (number_of_stations)
+            {
+                weighted_sum += m_cell_weight_vector[cell] * ( cell_sum / double(number_of_stations) );
+                total_weight += m_cell_weight_vector[cell];
+                number_of_cells_reporting++;
+            }
+        }
+
+        if (total_weight > 0.0)
+        {
+            mean_vector[month_index] = float(weighted_sum / total_weight);
+            cell_count_vector[month_index] = number_of_cells_reporting;
+        }
+    }
+}
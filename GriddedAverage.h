@@ -0,0 +1,64 @@
+//--------------------------------------------------------------------------------------
+// GriddedAverage.h
+// Area weighted national means for the monthly archives. A plain mean over
+// every station record lets regions with many stations outweigh the rest,
+// so stations are binned into latitude / longitude cells, averaged within
+// each cell, and the cells are combined with cos(latitude) weights.
+//
+// The cells are worked out once, when the grid is built. Every catalog
+// station gets a column, and columns are handed out in cell order so each
+// cell owns one contiguous run of them. Values are stored month major, one
+// row of columns per month, which makes the per month work a single pass
+// over a row: in effect a sparse matrix (cells by stations) times the month's
+// station vector.
+
+#ifndef GRIDDED_AVERAGE_H_INCLUDED
+#define GRIDDED_AVERAGE_H_INCLUDED
+
+#include <vector>
+#include <stddef.h>
+
+#include "USHCN.h"
+#include "StationCatalog.h"
+
+class GriddedAverage
+{
+public:
+                            GriddedAverage() : m_catalog(NULL), m_first_year(0), m_number_of_years(0) {}
+
+    // Assign every station in catalog, which has to outlive the grid, to a
+    // cell_size_degrees square cell. Cells line up with the equator and the
+    // prime meridian. Clears any values added before.
+    void                    build(const StationCatalog& catalog, float cell_size_degrees);
+
+    size_t                  getNumberOfCells() const { return m_cell_weight_vector.size(); }
+    unsigned int            getFirstYear() const { return m_first_year; }
+    size_t                  getNumberOfYears() const { return m_number_of_years; }
+
+    // Add one station's mean for a month. Repeats for the same station and
+    // month are averaged. Returns false, adding nothing, for stations that
+    // aren't in the catalog and years outside 0..MAX_YEARS-1.
+    bool                    add(unsigned int station_number, unsigned int year, size_t month, float temperature);
+
+    // Area weighted mean of every month from the first year on, (year - first
+    // year) * 12 + month, UNKNOWN_TEMPERATURE for months no cell reported.
+    // cell_count_vector gets how many cells reported each month.
+    void                    getMonthlyMeans(std::vector<float>& mean_vector, std::vector<unsigned int>& cell_count_vector) const;
+
+protected:
+    size_t                  getNumberOfColumns() const { return m_column_vector.size(); }
+
+    // Widen the year range to take in year, see MonthlyTotals::extend()
+    void                    extend(unsigned int year);
+
+    const StationCatalog*   m_catalog;
+    std::vector<unsigned int> m_column_vector;      // column of each catalog station, by dense id
+    std::vector<size_t>     m_cell_start_vector;    // cells + 1 offsets into the columns
+    std::vector<double>     m_cell_weight_vector;   // cos of each cell's centre latitude
+    unsigned int            m_first_year;
+    size_t                  m_number_of_years;
+    std::vector<float>      m_sum_vector;           // (year index * 12 + month) * columns + column
+    std::vector<unsigned short> m_count_vector;
+};
+
+#endif // GRIDDED_AVERAGE_H_INCLUDED
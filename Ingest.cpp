@@ -0,0 +1,537 @@
+//--------------------------------------------------------------------------------------
+// Ingest.cpp
+// Builds the Country -> State -> Station -> Year -> Month hierarchy
+// from a daily USHCN archive, optionally split across threads.
+
+#include <iostream>
+#include <string.h>
+#include <thread>
+#include <iterator>
+
+#include "Ingest.h"
+#include "RunStats.h"
+
+// Store the TMAX or TMIN readings of record in year_index of station and
+// raise (or lower) the records along the hierarchy that they beat
+static void
+addTemperatures(Country& US, State& current_state, Station& current_station, size_t year_index, DataRecord& record)
+{
+    // A month outside 1-12 used to throw out of the month vector
+    if ( record.getMonth() < 1 || record.getMonth() > NUMBER_OF_MONTHS_PER_YEAR )
+    {
+        return;
+    }
+
+    Year& current_year = current_station.getYearVector().at(year_index);
+    unsigned int current_year_number = current_year.getYear();
+    Month& current_month = current_year.getMonth( record.getMonth() - 1 );
+    DailyColumns& daily_columns = current_station.getDailyColumns();
+    size_t first_slot = DailyColumns::getSlot( year_index, record.getMonth() - 1, 0 );
+
+    // read in the TMAX and TMIN records for each day of the month
+    DataRecord::RECORD_TYPE record_type = record.getRecordType();
+
+    if ( record_type == DataRecord::RECORD_TYPE_TMAX || record_type == DataRecord::RECORD_TYPE_TMIN )
+    {
+        for (size_t day_number = 0; day_number < MAX_DAYS_IN_MONTH; day_number++)
+        {
+            float high_temperature = record.getHighTemperature(day_number);
+            float low_temperature = record.getLowTemperature(day_number);
+
+            if ( record_type == DataRecord::RECORD_TYPE_TMAX &&
+                high_temperature != UNKNOWN_TEMPERATURE &&
+                high_temperature < UNREASONABLE_HIGH_TEMPERATURE )
+            {
+                daily_columns.setMaxTemperature(first_slot + day_number, high_temperature);
+
+                if ( high_temperature > US.getRecordMaxTemperature() )
+                {
+                    US.setRecordMaxTemperature( high_temperature );
+                    US.setRecordMaxYear( current_year_number );
+                }
+
+                if ( high_temperature > current_state.getRecordMaxTemperature() )
+                {
+                    current_state.setRecordMaxTemperature( high_temperature );
+                    current_state.setRecordMaxYear( current_year_number );
+                }
+
+                if ( high_temperature > current_station.getRecordMaxTemperature() )
+                {
+                    current_station.setRecordMaxTemperature( high_temperature );
+                    current_station.setRecordMaxYear( current_year_number );
+                }
+
+                if ( high_temperature > current_year.getRecordMaxTemperature() )
+                {
+                    current_year.setRecordMaxTemperature( high_temperature );
+                    current_year.setRecordMaxMonth( record.getMonth() );
+                }
+
+                if ( high_temperature > current_month.getRecordMaxTemperature() )
+                {
+                    current_month.setRecordMaxTemperature( high_temperature );
+                    current_month.setRecordMaxDay( day_number + 1 );
+                }
+            }
+
+            if ( record_type == DataRecord::RECORD_TYPE_TMIN &&
+                low_temperature != UNKNOWN_TEMPERATURE  &&
+                low_temperature > UNREASONABLE_LOW_TEMPERATURE )
+            {
+                daily_columns.setMinTemperature(first_slot + day_number, low_temperature);
+
+                if ( low_temperature < US.getRecordMinTemperature() )
+                {
+                    US.setRecordMinTemperature( low_temperature );
+                    US.setRecordMinYear( current_year_number );
+                }
+
+                if ( low_temperature < current_state.getRecordMinTemperature() )
+                {
+                    current_state.setRecordMinTemperature( low_temperature );
+                    current_state.setRecordMinYear( current_year_number );
+                }
+
+                if ( low_temperature < current_station.getRecordMinTemperature() )
+                {
+                    current_station.setRecordMinTemperature( low_temperature );
+                    current_station.setRecordMinYear( current_year_number );
+                }
+
+                if ( low_temperature < current_year.getRecordMinTemperature() )
+                {
+                    current_year.setRecordMinTemperature( low_temperature );
+                    current_year.setRecordMinMonth( record.getMonth() );
+                }
+
+                if ( low_temperature < current_month.getRecordMinTemperature() )
+                {
+                    current_month.setRecordMinTemperature( low_temperature );
+                    current_month.setRecordMinDay( day_number );
+                }
+            }
+        }
+    }
+}
+
+void
+DailyIngest::parse(const char* begin, const char* end)
+{
+    DataRecord record;
+    uint64_t number_of_lines = 0;
+    uint64_t number_of_records = 0;
+    uint64_t number_of_short_lines = 0;
+
+    RunStats::get().add( COUNTER_INPUT_BYTES, uint64_t(end - begin) );
+
+    while (begin < end)
+    {
+        const char* line_end = (const char*)memchr(begin, '\n', end - begin);
+
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+
+        number_of_lines++;
+
+        if ( m_record_source.decodeDaily(begin, line_end - begin, record) )
+        {
+            addRecord(record);
+            number_of_records++;
+        }
+        else if ( size_t(line_end - begin) < DataRecord::MINIMUM_RECORD_LENGTH )
+        {
+            number_of_short_lines++;
+        }
+
+        begin = line_end + 1;
+    }
+
+    RunStats::get().add(COUNTER_LINES, number_of_lines);
+    RunStats::get().add(COUNTER_RECORDS, number_of_records);
+    RunStats::get().add(COUNTER_SHORT_LINES, number_of_short_lines);
+    RunStats::get().add(COUNTER_REJECTED_LINES, number_of_lines - number_of_records);
+}
+
+void
+DailyIngest::addRecord(DataRecord& record)
+{
+    Country& US = getCountry();
+
+    // Uncomment this if you want to see the station info printed as the file is parsed
+#if 0
+    if ( record.getYear() == getMostRecentYear() )
+    {
+        const StationInfo* station_info = m_station_catalog.find( record.getStationNumber() );
+        std::cout << record.getStateName() << " " << record.getStationNumber() << " ";
+        std::cout << ( station_info == NULL ? std::string() : station_info->getShortName() );
+        std::cout << " " << record.getRecordTypeString();
+        std::cout << " " << record.getMonth();
+        std::cout << " " << record.getYear();
+        std::cout << std::endl;
+    }
+#endif
+    // Build the database
+
+    // Look for a new state
+    if ( record.getStateNumber() != m_current_state_number )
+    {
+        m_current_state_number = record.getStateNumber();
+        getStateTransitionVector().push_back(m_current_state_number);
+
+        if ( getEchoStateNames() )
+        {
+            std::cerr << record.getStateName() << std::endl;
+        }
+
+        US.getStateVector().at(m_current_state_number - 1).setStateNumber(m_current_state_number);
+    }
+
+    // Look for a new station
+    if ( record.getStationNumber() != m_current_station_number )
+    {
+        m_current_station_number = record.getStationNumber();
+        // Every station gets its own first year, even if it matches the previous station's last one
+        m_current_year_number = 0;
+
+        // Stations in an archive tend to cover much the same years, so the
+        // longest one so far is a good guess at how much room this one needs.
+        // Room that goes unused is never touched, so it costs address space
+        // rather than memory.
+        std::vector<Station>& station_vector = US.getStateVector().at(m_current_state_number - 1).getStationVector();
+        const StationInfo* station_info = m_station_catalog.find(m_current_station_number);
+        station_vector.push_back( Station() );
+        Station& new_station = station_vector.back();
+        new_station.setStationNumber(m_current_station_number);
+        new_station.setStateName( record.getStateName() );
+        new_station.setStationName( station_info == NULL ? std::string() : station_info->getShortName() );
+        new_station.getDailyColumns().setCompact( US.getCompactStorage() );
+        new_station.reserveYears(m_longest_station_years);
+    }
+
+    // Look for a new year
+    if ( record.getYear() != m_current_year_number )
+    {
+        m_current_year_number = record.getYear();
+
+        if (m_current_year_number > m_most_recent_year)
+        {
+            m_most_recent_year = m_current_year_number;
+        }
+
+        Year new_year;
+        new_year.setYear(m_current_year_number);
+        Station& station = US.getStateVector().at(m_current_state_number - 1).getStationVector().back();
+        station.addYear(new_year);
+        m_longest_station_years = std::max( m_longest_station_years, station.getYearVector().size() );
+    }
+
+    State& current_state = US.getStateVector().at(m_current_state_number - 1);
+    Station& current_station = current_state.getStationVector().back();
+    addTemperatures( US, current_state, current_station, current_station.getYearVector().size() - 1, record );
+}
+
+void
+DailyIngest::mergeInto(Country& US, std::vector<unsigned int>& state_transition_vector)
+{
+    // Replay the state changes this chunk saw, dropping the first one
+    // if the previous chunk ended in the same state
+    std::vector<unsigned int>& transition_vector = getStateTransitionVector();
+
+    for (size_t i = 0; i < transition_vector.size(); i++)
+    {
+        if ( !state_transition_vector.empty() && transition_vector[i] == state_transition_vector.back() )
+        {
+            continue;
+        }
+
+        if ( !getEchoStateNames() )
+        {
+            std::cerr << STATE_NAMES[ transition_vector[i] ] << std::endl;
+        }
+
+        state_transition_vector.push_back( transition_vector[i] );
+    }
+
+    // Records only move on a strictly better value, so merging the chunks
+    // in file order keeps the earliest year, same as a serial scan
+    Country& partial = getCountry();
+
+    if ( partial.getRecordMaxTemperature() > US.getRecordMaxTemperature() )
+    {
+        US.setRecordMaxTemperature( partial.getRecordMaxTemperature() );
+        US.setRecordMaxYear( partial.getRecordMaxYear() );
+    }
+
+    if ( partial.getRecordMinTemperature() < US.getRecordMinTemperature() )
+    {
+        US.setRecordMinTemperature( partial.getRecordMinTemperature() );
+        US.setRecordMinYear( partial.getRecordMinYear() );
+    }
+
+    for (size_t state_number = 0; state_number < NUMBER_OF_STATES; state_number++)
+    {
+        State& partial_state = partial.getStateVector().at(state_number);
+        State& state = US.getStateVector().at(state_number);
+
+        if ( !partial_state.getStateNumber() )
+        {
+            continue;
+        }
+
+        state.setStateNumber( partial_state.getStateNumber() );
+
+        if ( partial_state.getRecordMaxTemperature() > state.getRecordMaxTemperature() )
+        {
+            state.setRecordMaxTemperature( partial_state.getRecordMaxTemperature() );
+            state.setRecordMaxYear( partial_state.getRecordMaxYear() );
+        }
+
+        if ( partial_state.getRecordMinTemperature() < state.getRecordMinTemperature() )
+        {
+            state.setRecordMinTemperature( partial_state.getRecordMinTemperature() );
+            state.setRecordMinYear( partial_state.getRecordMinYear() );
+        }
+
+        std::vector<Station>& partial_station_vector = partial_state.getStationVector();
+        std::vector<Station>& station_vector = state.getStationVector();
+        station_vector.insert( station_vector.end(),
+                               std::make_move_iterator( partial_station_vector.begin() ),
+                               std::make_move_iterator( partial_station_vector.end() ) );
+        partial_station_vector.clear();
+    }
+}
+
+// Find the start of the first record at or after position whose station
+// differs from the record before it. Short lines never start a chunk.
+static const char*
+findStationBoundary(const char* data, const char* position, const char* end)
+{
+    if ( position > data && position[-1] != '\n' )
+    {
+        const char* line_end = (const char*)memchr(position, '\n', end - position);
+        position = (line_end == NULL) ? end : line_end + 1;
+    }
+
+    const char* first_station = NULL;
+
+    while (position < end)
+    {
+        const char* line_end = (const char*)memchr(position, '\n', end - position);
+
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+
+        if ( size_t(line_end - position) >= DataRecord::MINIMUM_RECORD_LENGTH )
+        {
+            if (first_station == NULL)
+            {
+                first_station = position;
+            }
+            else if ( memcmp(first_station, position, 6) != 0 )
+            {
+                return position;
+            }
+        }
+
+        position = line_end + 1;
+    }
+
+    return end;
+}
+
+size_t
+ingestDailyArchive(const RecordSource& record_source, const char* data, size_t size, size_t number_of_threads,
+                   const StationCatalog& station_catalog, Country& US,
+                   std::vector<unsigned int>& state_transition_vector)
+{
+    const char* end = data + size;
+
+    if (number_of_threads <= 1)
+    {
+        DailyIngest ingest(record_source, station_catalog);
+        ingest.setEchoStateNames(true);
+        ingest.getCountry().setCompactStorage( US.getCompactStorage() );
+
+        {
+            StageTimer timer(STAGE_INGEST);
+            ingest.parse(data, end);
+        }
+
+        StageTimer timer(STAGE_MERGE);
+        ingest.mergeInto(US, state_transition_vector);
+        return ingest.getMostRecentYear();
+    }
+
+    std::vector<const char*> chunk_boundaries(1, data);
+
+    for (size_t i = 1; i < number_of_threads; i++)
+    {
+        const char* boundary = findStationBoundary( data, data + (size / number_of_threads) * i, end );
+        chunk_boundaries.push_back( (boundary > chunk_boundaries.back()) ? boundary : chunk_boundaries.back() );
+    }
+
+    chunk_boundaries.push_back(end);
+
+    std::vector<DailyIngest> partial_vector;
+    std::vector<std::thread> thread_vector;
+    partial_vector.reserve(number_of_threads);
+
+    for (size_t i = 0; i < number_of_threads; i++)
+    {
+        partial_vector.emplace_back(record_source, station_catalog);
+        partial_vector.back().getCountry().setCompactStorage( US.getCompactStorage() );
+    }
+
+    {
+        StageTimer timer(STAGE_INGEST);
+
+        for (size_t i = 0; i < number_of_threads; i++)
+        {
+            thread_vector.push_back( std::thread( &DailyIngest::parse, &partial_vector[i], chunk_boundaries[i], chunk_boundaries[i + 1] ) );
+        }
+
+        for (size_t i = 0; i < number_of_threads; i++)
+        {
+            thread_vector[i].join();
+        }
+    }
+
+    // Merged in file order once every chunk is parsed
+    StageTimer timer(STAGE_MERGE);
+    size_t most_recent_year = 0;
+
+    for (size_t i = 0; i < number_of_threads; i++)
+    {
+        partial_vector[i].mergeInto(US, state_transition_vector);
+
+        if ( partial_vector[i].getMostRecentYear() > most_recent_year )
+        {
+            most_recent_year = partial_vector[i].getMostRecentYear();
+        }
+    }
+
+    return most_recent_year;
+}
+
+bool
+applyDailyDelta(const RecordSource& record_source, const char* data, size_t size,
+                const StationCatalog& station_catalog, Country& US,
+                std::vector<unsigned int>& state_transition_vector, size_t& most_recent_year,
+                std::map<unsigned int, size_t>& changed_slot_map)
+{
+    std::vector<State>& state_vector = US.getStateVector();
+
+    // Where every station already is, as indexes since new stations can
+    // move a state's stations around
+    std::map<unsigned int, size_t> station_index_map;
+
+    for (size_t state_number = 0; state_number < state_vector.size(); state_number++)
+    {
+        std::vector<Station>& station_vector = state_vector[state_number].getStationVector();
+
+        for (size_t station_number = 0; station_number < station_vector.size(); station_number++)
+        {
+            station_index_map[ station_vector[station_number].getStationNumber() ] = station_number;
+        }
+    }
+
+    DataRecord record;
+    const char* begin = data;
+    const char* end = data + size;
+
+    while (begin < end)
+    {
+        const char* line_end = (const char*)memchr(begin, '\n', end - begin);
+
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+
+        bool decoded = record_source.decodeDaily(begin, line_end - begin, record);
+        begin = line_end + 1;
+
+        if ( !decoded || record.getStateNumber() < 1 || record.getStateNumber() > NUMBER_OF_STATES )
+        {
+            continue;
+        }
+
+        State& current_state = state_vector.at( record.getStateNumber() - 1 );
+
+        if ( !current_state.getStateNumber() )
+        {
+            current_state.setStateNumber( record.getStateNumber() );
+            state_transition_vector.push_back( record.getStateNumber() );
+        }
+
+        std::vector<Station>& station_vector = current_state.getStationVector();
+        std::map<unsigned int, size_t>::iterator index_it = station_index_map.find( record.getStationNumber() );
+
+        if ( index_it == station_index_map.end() )
+        {
+            const StationInfo* station_info = station_catalog.find( record.getStationNumber() );
+            station_vector.push_back( Station() );
+            Station& new_station = station_vector.back();
+            new_station.setStationNumber( record.getStationNumber() );
+            new_station.setStateName( record.getStateName() );
+            new_station.setStationName( station_info == NULL ? std::string() : station_info->getShortName() );
+            new_station.getDailyColumns().setCompact( US.getCompactStorage() );
+            index_it = station_index_map.insert( std::make_pair( record.getStationNumber(), station_vector.size() - 1 ) ).first;
+        }
+
+        Station& current_station = station_vector.at(index_it->second);
+        std::vector<Year>& year_vector = current_station.getYearVector();
+        size_t year_index = year_vector.size();
+
+        if ( year_vector.empty() || record.getYear() > year_vector.back().getYear() )
+        {
+            Year new_year;
+            new_year.setYear( record.getYear() );
+            current_station.addYear(new_year);
+        }
+        else
+        {
+            // The columns are laid out in year order, so a year can only be
+            // added on the end
+            while ( year_index > 0 && year_vector[year_index - 1].getYear() != record.getYear() )
+            {
+                year_index--;
+            }
+
+            if (year_index == 0)
+            {
+                std::cerr << "Delta has " << record.getYear() << " for station " << record.getStationNumber()
+                          << ", which is missing from before its last year" << std::endl;
+                return false;
+            }
+
+            year_index--;
+        }
+
+        if ( record.getYear() > most_recent_year )
+        {
+            most_recent_year = record.getYear();
+        }
+
+        addTemperatures(US, current_state, current_station, year_index, record);
+
+        size_t slot = (year_index * NUMBER_OF_MONTHS_PER_YEAR) + record.getMonth() - 1;
+        std::map<unsigned int, size_t>::iterator changed_it = changed_slot_map.find( record.getStationNumber() );
+
+        if ( changed_it == changed_slot_map.end() )
+        {
+            changed_slot_map[ record.getStationNumber() ] = slot;
+        }
+        else if (slot < changed_it->second)
+        {
+            changed_it->second = slot;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,86 @@
+//--------------------------------------------------------------------------------------
+// Ingest.h
+// Builds the Country -> State -> Station -> Year -> Month hierarchy
+// from a daily USHCN archive, optionally split across threads.
+
+#ifndef INGEST_H_INCLUDED
+#define INGEST_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <map>
+
+#include "USHCN.h"
+#include "RecordSource.h"
+#include "StationCatalog.h"
+
+// Builds a hierarchy from a run of consecutive daily records.
+// Each worker thread owns one of these for its chunk of the file,
+// the partial hierarchies are merged afterwards in file order.
+class DailyIngest
+{
+public:
+                            DailyIngest(const RecordSource& record_source, const StationCatalog& station_catalog) :
+                                            m_record_source(record_source),
+                                            m_station_catalog(station_catalog)
+                            {
+                                setCurrentStateNumber(0);
+                                setCurrentStationNumber(0);
+                                setCurrentYearNumber(0);
+                                setMostRecentYear(0);
+                                setEchoStateNames(false);
+                                m_longest_station_years = 0;
+                            }
+
+    Country&                getCountry() { return m_country; }
+    std::vector<unsigned int>& getStateTransitionVector() { return m_state_transition_vector; }
+    unsigned int            getCurrentStateNumber() { return m_current_state_number; }
+    void                    setCurrentStateNumber(unsigned int value) { m_current_state_number = value; }
+    unsigned int            getCurrentStationNumber() { return m_current_station_number; }
+    void                    setCurrentStationNumber(unsigned int value) { m_current_station_number = value; }
+    unsigned int            getCurrentYearNumber() { return m_current_year_number; }
+    void                    setCurrentYearNumber(unsigned int value) { m_current_year_number = value; }
+    size_t                  getMostRecentYear() { return m_most_recent_year; }
+    void                    setMostRecentYear(size_t value) { m_most_recent_year = value; }
+    bool                    getEchoStateNames() { return m_echo_state_names; }
+    void                    setEchoStateNames(bool flag) { m_echo_state_names = flag; }
+
+    void                    parse(const char* begin, const char* end);
+    void                    addRecord(DataRecord& record);
+    void                    mergeInto(Country& US, std::vector<unsigned int>& state_transition_vector);
+
+protected:
+    const RecordSource&     m_record_source;
+    const StationCatalog&   m_station_catalog;
+    Country                 m_country;
+    std::vector<unsigned int> m_state_transition_vector;
+    unsigned int            m_current_state_number;
+    unsigned int            m_current_station_number;
+    unsigned int            m_current_year_number;
+    size_t                  m_most_recent_year;
+    size_t                  m_longest_station_years;
+    bool                    m_echo_state_names;
+};
+
+// Parse a whole daily archive into US with record_source, using up to number_of_threads threads.
+// The file is cut into chunks at station boundaries, so the merged result
+// (and the state names shown on stderr along the way) match a single threaded
+// run. The states are appended to state_transition_vector in file order, for
+// the caller to print with the report. Stations get compact columns if
+// US.getCompactStorage() is set. Returns the most recent year seen.
+size_t ingestDailyArchive(const RecordSource& record_source, const char* data, size_t size, size_t number_of_threads,
+                          const StationCatalog& station_catalog, Country& US,
+                          std::vector<unsigned int>& state_transition_vector);
+
+// Add the daily records of a delta file to a US built earlier, e.g. one
+// loaded from a snapshot. New stations go on the end of their state and new
+// years on the end of their station; an earlier year has to be one the
+// station already has. For every station touched, changed_slot_map gets
+// the first month (year index * 12 + month) that was written. Returns
+// false, with US partly updated, if a record can't be placed.
+bool applyDailyDelta(const RecordSource& record_source, const char* data, size_t size,
+                     const StationCatalog& station_catalog, Country& US,
+                     std::vector<unsigned int>& state_transition_vector, size_t& most_recent_year,
+                     std::map<unsigned int, size_t>& changed_slot_map);
+
+#endif // INGEST_H_INCLUDED
@@ -0,0 +1,355 @@
+//--------------------------------------------------------------------------------------
+// Kernels.cpp
+// Block kernels for the per station record counting pass.
+//
+// The readings are whole degrees, so a month's worth of them sums exactly
+// in a float whatever order the lanes are added in. That keeps the vector
+// and scalar kernels bit for bit identical, and a float sum of compact
+// readings exactly their integer sum.
+
+#include <string.h>
+
+#include "Kernels.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define USHCN_HAVE_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// Compact readings are widened to the floats they stand for, missing ones
+// to UNKNOWN_TEMPERATURE, so both kinds of column scan the same way
+static inline float
+expandTemperature(float value)
+{
+    return value;
+}
+
+static inline float
+expandTemperature(int16_t value)
+{
+    return DailyColumns::expandCompactTemperature(value);
+}
+
+template <typename T>
+static inline void
+scanMaxBlockScalarTemplate(const T* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scan.sum = 0.0f;
+    scan.valid_mask = 0;
+    scan.greater_mask = 0;
+    scan.equal_mask = 0;
+
+    for (unsigned int day_number = 0; day_number < MAX_DAYS_IN_MONTH; day_number++)
+    {
+        float temperature = expandTemperature( temperatures[day_number] );
+
+        if (temperature != UNKNOWN_TEMPERATURE  && temperature < UNREASONABLE_HIGH_TEMPERATURE)
+        {
+            scan.sum += temperature;
+            scan.valid_mask |= 1u << day_number;
+
+            if ( temperature == record_temperatures[day_number] )
+            {
+                scan.equal_mask |= 1u << day_number;
+            }
+
+            if ( temperature > record_temperatures[day_number] )
+            {
+                scan.greater_mask |= 1u << day_number;
+                record_temperatures[day_number] = temperature;
+            }
+        }
+    }
+
+    scan.count = countBits(scan.valid_mask);
+}
+
+template <typename T>
+static inline void
+scanMinBlockScalarTemplate(const T* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scan.sum = 0.0f;
+    scan.valid_mask = 0;
+    scan.greater_mask = 0;
+    scan.equal_mask = 0;
+
+    for (unsigned int day_number = 0; day_number < MAX_DAYS_IN_MONTH; day_number++)
+    {
+        float temperature = expandTemperature( temperatures[day_number] );
+
+        if (temperature != UNKNOWN_TEMPERATURE  && temperature > UNREASONABLE_LOW_TEMPERATURE)
+        {
+            scan.sum += temperature;
+            scan.valid_mask |= 1u << day_number;
+
+            if ( temperature == record_temperatures[day_number] )
+            {
+                scan.equal_mask |= 1u << day_number;
+            }
+
+            if ( temperature < record_temperatures[day_number] )
+            {
+                scan.greater_mask |= 1u << day_number;
+                record_temperatures[day_number] = temperature;
+            }
+        }
+    }
+
+    scan.count = countBits(scan.valid_mask);
+}
+
+void
+scanMaxBlockScalar(const float* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanMaxBlockScalarTemplate(temperatures, record_temperatures, scan);
+}
+
+void
+scanMinBlockScalar(const float* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanMinBlockScalarTemplate(temperatures, record_temperatures, scan);
+}
+
+void
+scanMaxCompactBlockScalar(const int16_t* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanMaxBlockScalarTemplate(temperatures, record_temperatures, scan);
+}
+
+void
+scanMinCompactBlockScalar(const int16_t* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanMinBlockScalarTemplate(temperatures, record_temperatures, scan);
+}
+
+#ifdef USHCN_HAVE_AVX2_KERNELS
+
+// The i'th vector of 8 readings. The last one only has 7 and its last lane
+// is masked off, so we never read past the block.
+__attribute__((target("avx2")))
+static inline __m256
+loadTemperaturesAvx2(const float* temperatures, unsigned int i, __m256i tail)
+{
+    return (i == 3) ? _mm256_maskload_ps(temperatures + 24, tail) : _mm256_loadu_ps(temperatures + (i * 8));
+}
+
+// Compact readings are widened to floats, missing ones to UNKNOWN_TEMPERATURE.
+// The last vector is padded with a missing reading instead of masked.
+__attribute__((target("avx2")))
+static inline __m256
+loadTemperaturesAvx2(const int16_t* temperatures, unsigned int i, __m256i /*tail*/)
+{
+    __m128i packed;
+
+    if (i == 3)
+    {
+        int16_t last[8];
+        memcpy( last, temperatures + 24, 7 * sizeof(int16_t) );
+        last[7] = COMPACT_MISSING_TEMPERATURE;
+        packed = _mm_loadu_si128( (const __m128i*)last );
+    }
+    else
+    {
+        packed = _mm_loadu_si128( (const __m128i*)(temperatures + (i * 8)) );
+    }
+
+    __m128i missing = _mm_cmpeq_epi16( packed, _mm_set1_epi16(COMPACT_MISSING_TEMPERATURE) );
+    packed = _mm_blendv_epi8( packed, _mm_set1_epi16( int16_t(UNKNOWN_TEMPERATURE) ), missing );
+    return _mm256_cvtepi32_ps( _mm256_cvtepi16_epi32(packed) );
+}
+
+// 31 days is three full vectors of 8 plus a last one of 7, the last lane
+// of which is masked off so we never read or write past the block.
+template <bool IS_MAX, typename T>
+__attribute__((target("avx2")))
+static inline void
+scanBlockAvx2(const T* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    const __m256 unknown = _mm256_set1_ps(UNKNOWN_TEMPERATURE);
+    const __m256 limit = _mm256_set1_ps( IS_MAX ? UNREASONABLE_HIGH_TEMPERATURE : UNREASONABLE_LOW_TEMPERATURE );
+    const __m256i tail = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, -1, 0);
+    __m256 sum = _mm256_setzero_ps();
+    uint32_t valid_mask = 0;
+    uint32_t greater_mask = 0;
+    uint32_t equal_mask = 0;
+
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        bool last = (i == 3);
+        __m256 temperature = loadTemperaturesAvx2(temperatures, i, tail);
+        __m256 record = last ? _mm256_maskload_ps(record_temperatures + 24, tail) : _mm256_loadu_ps(record_temperatures + (i * 8));
+
+        __m256 valid = _mm256_and_ps( _mm256_cmp_ps(temperature, unknown, _CMP_NEQ_OQ),
+                                      _mm256_cmp_ps(temperature, limit, IS_MAX ? _CMP_LT_OQ : _CMP_GT_OQ) );
+
+        if (last)
+        {
+            valid = _mm256_and_ps( valid, _mm256_castsi256_ps(tail) );
+        }
+
+        __m256 greater = _mm256_and_ps( valid, _mm256_cmp_ps(temperature, record, IS_MAX ? _CMP_GT_OQ : _CMP_LT_OQ) );
+        __m256 equal = _mm256_and_ps( valid, _mm256_cmp_ps(temperature, record, _CMP_EQ_OQ) );
+
+        sum = _mm256_add_ps( sum, _mm256_and_ps(valid, temperature) );
+        record = _mm256_blendv_ps(record, temperature, greater);
+
+        if (last)
+        {
+            _mm256_maskstore_ps(record_temperatures + 24, tail, record);
+        }
+        else
+        {
+            _mm256_storeu_ps(record_temperatures + (i * 8), record);
+        }
+
+        valid_mask |= uint32_t( _mm256_movemask_ps(valid) ) << (i * 8);
+        greater_mask |= uint32_t( _mm256_movemask_ps(greater) ) << (i * 8);
+        equal_mask |= uint32_t( _mm256_movemask_ps(equal) ) << (i * 8);
+    }
+
+    __m128 half = _mm_add_ps( _mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1) );
+    half = _mm_add_ps( half, _mm_movehl_ps(half, half) );
+    half = _mm_add_ss( half, _mm_shuffle_ps(half, half, 1) );
+
+    scan.sum = _mm_cvtss_f32(half);
+    scan.valid_mask = valid_mask;
+    scan.greater_mask = greater_mask;
+    scan.equal_mask = equal_mask;
+    scan.count = countBits(valid_mask);
+}
+
+__attribute__((target("avx2")))
+static void
+scanMaxBlockAvx2(const float* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanBlockAvx2<true>(temperatures, record_temperatures, scan);
+}
+
+__attribute__((target("avx2")))
+static void
+scanMinBlockAvx2(const float* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanBlockAvx2<false>(temperatures, record_temperatures, scan);
+}
+
+__attribute__((target("avx2")))
+static void
+scanMaxCompactBlockAvx2(const int16_t* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanBlockAvx2<true>(temperatures, record_temperatures, scan);
+}
+
+__attribute__((target("avx2")))
+static void
+scanMinCompactBlockAvx2(const int16_t* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scanBlockAvx2<false>(temperatures, record_temperatures, scan);
+}
+
+static bool
+haveAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif // USHCN_HAVE_AVX2_KERNELS
+
+static ScanBlockFunction
+selectScanMaxBlock()
+{
+#ifdef USHCN_HAVE_AVX2_KERNELS
+    if ( haveAvx2() )
+    {
+        return scanMaxBlockAvx2;
+    }
+#endif
+    return scanMaxBlockScalar;
+}
+
+static ScanBlockFunction
+selectScanMinBlock()
+{
+#ifdef USHCN_HAVE_AVX2_KERNELS
+    if ( haveAvx2() )
+    {
+        return scanMinBlockAvx2;
+    }
+#endif
+    return scanMinBlockScalar;
+}
+
+static ScanCompactBlockFunction
+selectScanMaxCompactBlock()
+{
+#ifdef USHCN_HAVE_AVX2_KERNELS
+    if ( haveAvx2() )
+    {
+        return scanMaxCompactBlockAvx2;
+    }
+#endif
+    return scanMaxCompactBlockScalar;
+}
+
+static ScanCompactBlockFunction
+selectScanMinCompactBlock()
+{
+#ifdef USHCN_HAVE_AVX2_KERNELS
+    if ( haveAvx2() )
+    {
+        return scanMinCompactBlockAvx2;
+    }
+#endif
+    return scanMinCompactBlockScalar;
+}
+
+static const ScanBlockFunction scan_max_block_function = selectScanMaxBlock();
+static const ScanBlockFunction scan_min_block_function = selectScanMinBlock();
+static const ScanCompactBlockFunction scan_max_compact_block_function = selectScanMaxCompactBlock();
+static const ScanCompactBlockFunction scan_min_compact_block_function = selectScanMinCompactBlock();
+
+void
+scanMaxBlock(const float* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scan_max_block_function(temperatures, record_temperatures, scan);
+}
+
+void
+scanMinBlock(const float* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scan_min_block_function(temperatures, record_temperatures, scan);
+}
+
+void
+scanMaxCompactBlock(const int16_t* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scan_max_compact_block_function(temperatures, record_temperatures, scan);
+}
+
+void
+scanMinCompactBlock(const int16_t* temperatures, float* record_temperatures, BlockScan& scan)
+{
+    scan_min_compact_block_function(temperatures, record_temperatures, scan);
+}
+
+void
+scanMonthBlocks(DailyColumns& daily_columns, size_t year_index, size_t month, float* record_max_temperatures, float* record_min_temperatures,
+                BlockScan& max_scan, BlockScan& min_scan)
+{
+    if ( daily_columns.isCompact() )
+    {
+        scanMaxCompactBlock(daily_columns.getCompactMaxTemperatures(year_index, month), record_max_temperatures, max_scan);
+        scanMinCompactBlock(daily_columns.getCompactMinTemperatures(year_index, month), record_min_temperatures, min_scan);
+    }
+    else
+    {
+        scanMaxBlock(daily_columns.getMaxTemperatures(year_index, month), record_max_temperatures, max_scan);
+        scanMinBlock(daily_columns.getMinTemperatures(year_index, month), record_min_temperatures, min_scan);
+    }
+}
+
+const char*
+getKernelName()
+{
+    return (scan_max_block_function == scanMaxBlockScalar) ? "scalar" : "avx2";
+}
@@ -0,0 +1,88 @@
+//--------------------------------------------------------------------------------------
+// Kernels.h
+// Block kernels for the per station record counting pass. Each call handles
+// one month of 31 daily slots, with an AVX2 version picked at run time
+// when the CPU has it and a scalar version otherwise.
+
+#ifndef KERNELS_H_INCLUDED
+#define KERNELS_H_INCLUDED
+
+#include <stdint.h>
+
+#include "USHCN.h"
+
+// What a block scan found. Bit d of each mask refers to day d of the month.
+struct BlockScan
+{
+    float                   sum;            // sum of the usable readings
+    unsigned int            count;          // number of usable readings
+    uint32_t                valid_mask;     // usable readings
+    uint32_t                greater_mask;   // readings that set a new record
+    uint32_t                equal_mask;     // readings that tied the existing record
+};
+
+typedef void (*ScanBlockFunction)(const float* temperatures, float* record_temperatures, BlockScan& scan);
+typedef void (*ScanCompactBlockFunction)(const int16_t* temperatures, float* record_temperatures, BlockScan& scan);
+
+// Scan 31 TMAX (or TMIN) readings against the running per day record highs
+// (or lows). Readings that are UNKNOWN_TEMPERATURE or beyond the
+// UNREASONABLE_* limits are skipped. Ties are flagged before the records
+// are raised (or lowered) in place, matching a day by day scalar walk.
+void                        scanMaxBlock(const float* temperatures, float* record_temperatures, BlockScan& scan);
+void                        scanMinBlock(const float* temperatures, float* record_temperatures, BlockScan& scan);
+
+// The same scans over compact columns (see DailyColumns). Missing readings
+// are COMPACT_MISSING_TEMPERATURE, the records stay floats.
+void                        scanMaxCompactBlock(const int16_t* temperatures, float* record_temperatures, BlockScan& scan);
+void                        scanMinCompactBlock(const int16_t* temperatures, float* record_temperatures, BlockScan& scan);
+
+// Always available reference versions, used by the benchmark
+void                        scanMaxBlockScalar(const float* temperatures, float* record_temperatures, BlockScan& scan);
+void                        scanMinBlockScalar(const float* temperatures, float* record_temperatures, BlockScan& scan);
+void                        scanMaxCompactBlockScalar(const int16_t* temperatures, float* record_temperatures, BlockScan& scan);
+void                        scanMinCompactBlockScalar(const int16_t* temperatures, float* record_temperatures, BlockScan& scan);
+
+// Scan one month of a station's TMAX and TMIN columns, whichever kind they are
+void                        scanMonthBlocks(DailyColumns& daily_columns, size_t year_index, size_t month,
+                                            float* record_max_temperatures, float* record_min_temperatures,
+                                            BlockScan& max_scan, BlockScan& min_scan);
+
+// Name of the kernel set picked for this CPU, "avx2" or "scalar"
+const char*                 getKernelName();
+
+inline unsigned int
+countBits(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_popcount(mask);
+#else
+    unsigned int count = 0;
+
+    for ( ; mask; mask &= mask - 1)
+    {
+        count++;
+    }
+
+    return count;
+#endif
+}
+
+// Index of the lowest set bit, mask must not be zero
+inline unsigned int
+lowestBit(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctz(mask);
+#else
+    unsigned int index = 0;
+
+    for ( ; !(mask & 1); mask >>= 1)
+    {
+        index++;
+    }
+
+    return index;
+#endif
+}
+
+#endif // KERNELS_H_INCLUDED
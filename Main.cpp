@@ -11,190 +11,834 @@
 // and you will always get the same result.
 
 #include <iostream>
-#include <iomanip>
 #include <fstream>
 #include <string>
 #include <sstream>
 #include <map>
+#include <string.h>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <algorithm>
 
 #include "USHCN.h"
+#include "MappedFile.h"
+#include "Ingest.h"
+#include "Snapshot.h"
+#include "RecordSource.h"
+#include "QueryServer.h"
+#include "RecordSearch.h"
+#include "StationCatalog.h"
+#include "SpatialIndex.h"
+#include "GriddedAverage.h"
+#include "RunStats.h"
+#include "ReportWriter.h"
+#include "ColumnTable.h"
+
+// threads= above this is taken as a mistake rather than a thread count
+static const long           MAX_THREADS = 1024;
+
+// Mean of the period months ending at month_index, from running totals of
+// the monthly averages (running_total_vector[i] is the sum of the first i).
+// Months before the start of the run count as UNKNOWN_TEMPERATURE.
+static float
+rollingWindowMean(std::vector<double>& running_total_vector, size_t month_index, int period)
+{
+    double sum = 0.0;
+    size_t window_end = month_index + 1;
 
-std::map<size_t, bool> months_under_test_map;
-size_t most_recent_year = 0;
+    if ( period > 0 && window_end >= size_t(period) )
+    {
+        sum = running_total_vector[window_end] - running_total_vector[window_end - period];
+    }
+    else if (period > 0)
+    {
+        sum = running_total_vector[window_end] + double(UNKNOWN_TEMPERATURE) * double(period - window_end);
+    }
+
+    return float(sum) / float(period);
+}
 
-void parseUSHCN_2(std::string record_string, std::ifstream& ushcn_data_file, std::string input_file_name_string, size_t month_under_test, size_t months_under_test, int number_of_months_for_sequential_statistics)
+// Which window lengths to rank, and how
+struct WindowOptions
 {
-    Country US;
-    std::vector<State>& state_vector = US.getStateVector();
+    int                     first_period;
+    int                     last_period;
+    size_t                  top_windows;
+    size_t                  number_of_threads;
+};
+
+// Everything one run of the report is asked for on the command line. A batch
+// run reads one of these per line of its query file.
+struct QueryOptions
+{
+                            QueryOptions();
+
+    size_t                  station_under_test;
+    size_t                  year_under_test;
+    size_t                  month_under_test;
+    size_t                  months_under_test;
+    bool                    months_under_test_map[NUMBER_OF_MONTHS_PER_YEAR + 1];
+    size_t                  month_to_dump;
+    size_t                  day_to_dump;
+    size_t                  year_to_dump;
+    int                     number_of_months_for_sequential_statistics;
+    size_t                  start_year_for_comparing_records;
+    size_t                  top_windows;
+    int                     first_period;
+    int                     last_period;
+    bool                    near_filter;
+    float                   near_latitude;
+    float                   near_longitude;
+    float                   near_radius_km;
+    bool                    box_filter;
+    float                   box_min_latitude;
+    float                   box_min_longitude;
+    float                   box_max_latitude;
+    float                   box_max_longitude;
+    float                   grid_cell_degrees;
+    std::string             export_prefix;
+};
+
+QueryOptions::QueryOptions() :
+                            station_under_test(0),
+                            year_under_test(0),
+                            month_under_test(0),
+                            months_under_test(1),
+                            month_to_dump(0),
+                            day_to_dump(0),
+                            year_to_dump(0),
+                            number_of_months_for_sequential_statistics(12),
+                            start_year_for_comparing_records(1930),
+                            top_windows(0),
+                            first_period(0),
+                            last_period(0),
+                            near_filter(false),
+                            near_latitude(0.0f),
+                            near_longitude(0.0f),
+                            near_radius_km(0.0f),
+                            box_filter(false),
+                            box_min_latitude(0.0f),
+                            box_min_longitude(0.0f),
+                            box_max_latitude(0.0f),
+                            box_max_longitude(0.0f),
+                            grid_cell_degrees(0.0f),
+                            export_prefix("")
+{
+    for (size_t month = 0; month <= NUMBER_OF_MONTHS_PER_YEAR; month++)
+    {
+        months_under_test_map[month] = false;
+    }
+}
+
+// Without periods= only the one period= window length is ranked
+static WindowOptions
+getWindowOptions(const QueryOptions& options, size_t number_of_threads)
+{
+    WindowOptions window_options;
+    window_options.first_period = options.first_period ? options.first_period : options.number_of_months_for_sequential_statistics;
+    window_options.last_period = options.first_period ? options.last_period : options.number_of_months_for_sequential_statistics;
+    window_options.top_windows = options.top_windows;
+    window_options.number_of_threads = number_of_threads;
+    return window_options;
+}
+
+// Parse count comma separated numbers, false unless there are exactly that many
+static bool
+parseCoordinateList(const std::string& list_string, float* values, size_t count)
+{
+    const char* position = list_string.c_str();
 
-    float total_monthly_temperature_sum[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float average_monthly_temperature[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float yearly_temperature[MAX_YEARS];
-    unsigned int number_of_monthly_temperature_records[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+    for (size_t i = 0; i < count; i++)
+    {
+        char* end = NULL;
+        values[i] = (float)strtod(position, &end);
 
-    float total_fabricated_monthly_temperature_sum[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float average_fabricated_monthly_temperature[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float fabricated_yearly_temperature[MAX_YEARS];
-    unsigned int number_of_fabricated_monthly_temperature_records[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+        if ( end == position || *end != ( (i + 1 < count) ? ',' : '\0' ) )
+        {
+            return false;
+        }
 
-    float total_non_fabricated_monthly_temperature_sum[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float average_non_fabricated_monthly_temperature[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float non_fabricated_yearly_temperature[MAX_YEARS];
-    unsigned int number_of_non_fabricated_monthly_temperature_records[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+        position = end + 1;
+    }
 
-    size_t first_month = month_under_test;
-    size_t last_month = month_under_test + months_under_test - 1;
+    return true;
+}
 
-    for (size_t i = 0; i < MAX_YEARS; i++)
+// Apply one query argument to options, echoing it the way the command line
+// always has. Returns 1 if it was a query argument, 0 if it wasn't and -1 if
+// it was malformed.
+static int
+parseQueryArgument(const std::string& argument_string, QueryOptions& options, ReportWriter& out)
+{
+    if ( argument_string.find("year=") != std::string::npos )
     {
-        yearly_temperature[i] = 0.0f;
+        std::string year_string = argument_string.substr(5, 4);
+        options.year_under_test = (size_t)strtol(year_string.c_str(), NULL, 10);
+        out << year_string << std::endl;
+        std::cerr << year_string << std::endl;
+    }
+    else if ( argument_string.find("station=") != std::string::npos )
+    {
+        std::string station_string = argument_string.substr(8, 6);
+        options.station_under_test = (size_t)strtol(station_string.c_str(), NULL, 10);
+        out << "Station " << options.station_under_test << std::endl;
+        std::cerr << "Station " << options.station_under_test << std::endl;
+    }
+    else if ( argument_string.find("start=") != std::string::npos )
+    {
+        std::string year_string = argument_string.substr(6, 4);
+        options.start_year_for_comparing_records = (size_t)strtol(year_string.c_str(), NULL, 10);
+        out << "Start year " << options.start_year_for_comparing_records << std::endl;
+        std::cerr << "Start year " << options.start_year_for_comparing_records << std::endl;
+    }
+    else if ( argument_string.find("month=") != std::string::npos )
+    {
+        std::string month_string = argument_string.substr(6, 2);
+        options.month_under_test = (size_t)strtol(month_string.c_str(), NULL, 10);
 
-        for (size_t j = 0; j < NUMBER_OF_MONTHS_PER_YEAR; j++)
+        if (options.month_under_test <= NUMBER_OF_MONTHS_PER_YEAR)
         {
-            total_monthly_temperature_sum[i][j] = 0.0f;
-            number_of_monthly_temperature_records[i][j] = 0;
-            average_monthly_temperature[i][j] = UNKNOWN_TEMPERATURE;
-            total_fabricated_monthly_temperature_sum[i][j] = 0.0f;
-            number_of_fabricated_monthly_temperature_records[i][j] = 0;
-            average_fabricated_monthly_temperature[i][j] = UNKNOWN_TEMPERATURE;
-            total_non_fabricated_monthly_temperature_sum[i][j] = 0.0f;
-            number_of_non_fabricated_monthly_temperature_records[i][j] = 0;
-            average_non_fabricated_monthly_temperature[i][j] = UNKNOWN_TEMPERATURE;
+            options.months_under_test_map[options.month_under_test] = true;
         }
+
+        out << "Month " << month_string << std::endl;
+        std::cerr << "Month " << month_string << std::endl;
     }
+    else if ( argument_string.find("months=") != std::string::npos )
+    {
+        std::string months_string = argument_string.substr(7, 2);
+        options.months_under_test = (size_t)strtol(months_string.c_str(), NULL, 10);
+        out << "Number of months " << options.months_under_test << std::endl;
+        std::cerr << "Number of months " << options.months_under_test << std::endl;
 
-    unsigned int type_flag;
-    std::string current_state_name = "";
+        for (size_t i = 0; i < options.months_under_test; i++)
+        {
+            size_t valid_month = ( options.month_under_test + i ) % 12;
+            valid_month = (valid_month == 0) ? 12 : valid_month;
+            options.months_under_test_map[valid_month] = true;
+            std::cerr << "Month under test " << valid_month << std::endl;
+        }
+    }
+    else if ( argument_string.find("periods=") != std::string::npos )
+    {
+        // periods=FIRST..LAST, or a single period
+        std::string periods_string = argument_string.substr(8, argument_string.size() - 8);
+        size_t dots = periods_string.find("..");
+        options.first_period = (int)strtol(periods_string.c_str(), NULL, 10);
+        options.last_period = (dots == std::string::npos) ? options.first_period : (int)strtol(periods_string.substr(dots + 2).c_str(), NULL, 10);
+
+        if (options.first_period < 1 || options.last_period < options.first_period)
+        {
+            std::cerr << "Bad period range " << periods_string << std::endl;
+            return (-1);
+        }
+
+        std::cerr << "Periods " << options.first_period << " to " << options.last_period << std::endl;
+    }
+    else if ( argument_string.find("period=") != std::string::npos )
+    {
+        size_t length = argument_string.size();
+        std::string period_string = argument_string.substr(7, length - 7);
+        options.number_of_months_for_sequential_statistics = (int)strtol(period_string.c_str(), NULL, 10);
+        out << period_string << std::endl;
+        std::cerr << period_string << std::endl;
+    }
+    else if ( argument_string.find("top=") != std::string::npos )
+    {
+        std::string top_string = argument_string.substr(4, argument_string.size() - 4);
+        options.top_windows = (size_t)strtol(top_string.c_str(), NULL, 10);
+        std::cerr << "Top " << options.top_windows << " periods" << std::endl;
+    }
+    else if ( argument_string.find("date=") != std::string::npos )
+    {
+        std::string dump_date_string = argument_string.substr(5, 4);
+        options.month_to_dump = (size_t)strtol(dump_date_string.substr(0, 2).c_str(), NULL, 10);
+        options.day_to_dump = (size_t)strtol(dump_date_string.substr(2, 2).c_str(), NULL, 10);
+
+        if ( argument_string.size() == 13 )
+        {
+            options.year_to_dump = (size_t)strtol(argument_string.substr(9, 4).c_str(), NULL, 10);
+        }
+    }
+    else if ( argument_string.find("near=") != std::string::npos )
+    {
+        // near=LAT,LON,RADIUS_KM
+        std::string near_string = argument_string.substr(5, argument_string.size() - 5);
+        float values[3];
+
+        if ( !parseCoordinateList(near_string, values, 3) || values[2] < 0.0f )
+        {
+            std::cerr << "Bad near " << near_string << std::endl;
+            return (-1);
+        }
 
-    if ( record_string.substr(0, 3) == "USH" )
+        options.near_filter = true;
+        options.near_latitude = values[0];
+        options.near_longitude = values[1];
+        options.near_radius_km = values[2];
+        std::cerr << "Within " << options.near_radius_km << " km of " << options.near_latitude << ", " << options.near_longitude << std::endl;
+    }
+    else if ( argument_string.find("bbox=") != std::string::npos )
     {
-        do
+        // bbox=MIN_LAT,MIN_LON,MAX_LAT,MAX_LON
+        std::string box_string = argument_string.substr(5, argument_string.size() - 5);
+        float values[4];
+
+        if ( !parseCoordinateList(box_string, values, 4) || values[0] > values[2] || values[1] > values[3] )
         {
-            unsigned int station_number = strtoul( record_string.substr(5, 6).c_str(), NULL, 10 );
-            unsigned int state_number = strtoul( record_string.substr(5, 2).c_str(), NULL, 10 );
-            std::string state_name = STATE_NAMES[state_number];
+            std::cerr << "Bad bbox " << box_string << std::endl;
+            return (-1);
+        }
 
-            if (state_name != current_state_name)
-            {
-                std::cout << state_name << std::endl;
-                //std::cerr << state_name << std::endl;
-                current_state_name = state_name;
-            }
+        options.box_filter = true;
+        options.box_min_latitude = values[0];
+        options.box_min_longitude = values[1];
+        options.box_max_latitude = values[2];
+        options.box_max_longitude = values[3];
+        std::cerr << "Box " << values[0] << ", " << values[1] << " to " << values[2] << ", " << values[3] << std::endl;
+    }
+    else if ( argument_string.find("grid=") != std::string::npos )
+    {
+        std::string grid_string = argument_string.substr(5, argument_string.size() - 5);
+        options.grid_cell_degrees = (float)strtod(grid_string.c_str(), NULL);
 
-            unsigned int year = strtoul( record_string.substr(12, 4).c_str(), NULL, 10 );
+        if ( !(options.grid_cell_degrees > 0.0f) )
+        {
+            std::cerr << "Bad grid " << grid_string << std::endl;
+            return (-1);
+        }
 
-            if (year > most_recent_year)
-            {
-                most_recent_year = year;
-            }
+        std::cerr << "Grid " << options.grid_cell_degrees << " degree cells" << std::endl;
+    }
+    else if ( argument_string.find("out=") != std::string::npos )
+    {
+        options.export_prefix = argument_string.substr(4, argument_string.size() - 4);
 
-            size_t position = 16;
+        if ( options.export_prefix.empty() )
+        {
+            std::cerr << "Bad out " << argument_string << std::endl;
+            return (-1);
+        }
 
-            for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
-            {
-                if ( ( month_under_test && !months_under_test_map[month + 1] ) || ( record_string.substr(position, 6) == " -9999" ) )
-                {
-                    position += 9;
-                    continue;
-                }
+        std::cerr << "Export " << options.export_prefix << std::endl;
+    }
+    else
+    {
+        return (0);
+    }
 
-                float temperature = (float)( strtol( record_string.substr(position, 6).c_str(), NULL, 10 ) ) / 100.0f;
-                temperature = (temperature * 1.8f) + 32;
-                position += 6;
+    return (1);
+}
 
-                std::string dmflag = record_string.substr(position, 1);
+// COOP IDs of the catalog stations that pass the near= and bbox= filters,
+// sorted. Returns false, leaving the vector empty, when neither was given.
+static bool
+selectStations(const StationCatalog& station_catalog, const SpatialIndex& spatial_index, const QueryOptions& options,
+               std::vector<unsigned int>& selected_station_vector)
+{
+    selected_station_vector.clear();
 
-                total_monthly_temperature_sum[year][month] += temperature;
-                number_of_monthly_temperature_records[year][month]++;
+    if ( !options.near_filter && !options.box_filter )
+    {
+        return false;
+    }
 
-                if (dmflag == "E")
-                {
-                	//std::cerr << "found fabricated temp" << std::endl;
-                	total_fabricated_monthly_temperature_sum[year][month] += temperature;
-                	number_of_fabricated_monthly_temperature_records[year][month]++;
-                }
-                else
-                {
-                	//std::cerr << "found fabricated temp" << std::endl;
-                	total_non_fabricated_monthly_temperature_sum[year][month] += temperature;
-                	number_of_non_fabricated_monthly_temperature_records[year][month]++;
-                }
+    std::vector<size_t> station_id_vector;
 
-                position += 3;
-            }
+    if (options.near_filter)
+    {
+        spatial_index.findNear(options.near_latitude, options.near_longitude, options.near_radius_km, station_id_vector);
+    }
+    else
+    {
+        spatial_index.findInBox(options.box_min_latitude, options.box_min_longitude, options.box_max_latitude, options.box_max_longitude,
+                                station_id_vector);
+    }
+
+    for (size_t i = 0; i < station_id_vector.size(); i++)
+    {
+        const StationInfo& info = station_catalog[ station_id_vector[i] ];
+
+        // With both filters a station has to be in the circle and the box
+        if (   options.near_filter && options.box_filter
+            && (   info.latitude < options.box_min_latitude || info.latitude > options.box_max_latitude
+                || info.longitude < options.box_min_longitude || info.longitude > options.box_max_longitude ) )
+        {
+            continue;
+        }
 
-            getline(ushcn_data_file, record_string);
-        } while ( ushcn_data_file.good() );
+        selected_station_vector.push_back(info.station_number);
+    }
+
+    std::cerr << "Selected " << selected_station_vector.size() << " stations" << std::endl;
+    return true;
+}
+
+// Rolling windows for the monthly archives, ending on every month with data.
+// Windows reaching back before the first year are padded, see rollingWindowMean().
+struct MonthlyWindows
+{
+    std::vector<double>     running_total_vector;
+    std::vector<size_t>     month_index_vector;
+    std::vector<size_t>     month_number_vector;
+
+                            MonthlyWindows() : running_total_vector(1, 0.0) {}
+
+    void                    operator()(int period, WindowRanking& ranking)
+                            {
+                                for (size_t i = 0; i < month_index_vector.size(); i++)
+                                {
+                                    ranking.add( rollingWindowMean(running_total_vector, month_index_vector[i], period), month_number_vector[i] );
+                                }
+                            }
+};
+
+// Rolling windows for the daily reports. running_total_vector has one entry
+// per month with readings, and a window only ends on a month that follows at
+// least period consecutive months.
+struct DailyWindows
+{
+    std::vector<float>      running_total_vector;
+    std::vector<int>        consecutive_count_vector;
+    std::vector<size_t>     month_number_vector;
+
+    void                    add(float running_total, int consecutive_count, size_t month_number)
+                            {
+                                running_total_vector.push_back(running_total);
+                                consecutive_count_vector.push_back(consecutive_count);
+                                month_number_vector.push_back(month_number);
+                            }
+
+    void                    operator()(int period, WindowRanking& ranking)
+                            {
+                                for (size_t i = 0; i < running_total_vector.size(); i++)
+                                {
+                                    if (consecutive_count_vector[i] >= period)
+                                    {
+                                        float total_variable_month_temperature = running_total_vector.at(i) - running_total_vector.at(i - period);
+                                        float average_temperature = total_variable_month_temperature / float(period);
+                                        ranking.add(average_temperature, month_number_vector[i]);
+                                    }
+                                }
+                            }
+};
+
+// Series numbers in the exported tables. For daily archives they are the
+// mean, maximum and minimum temperatures, for monthly archives every month,
+// the fabricated ones and the rest.
+enum ExportSeries
+{
+    SERIES_MEAN = 0,
+    SERIES_MAXIMUM = 1,
+    SERIES_MINIMUM = 2,
+    SERIES_ALL = 0,
+    SERIES_FABRICATED = 1,
+    SERIES_NON_FABRICATED = 2
+};
+
+// Columns of the rankings table
+static void
+addRankingColumns(ColumnTable& table)
+{
+    table.addColumn("series", COLUMN_INT32);
+    table.addColumn("period", COLUMN_INT32);
+    table.addColumn("rank", COLUMN_UINT32);
+    table.addColumn("year", COLUMN_INT32);
+    table.addColumn("month", COLUMN_INT32);
+    table.addColumn("mean", COLUMN_FLOAT32);
+}
+
+// The ranked windows of one period, as WindowRanking::print() lists them
+static void
+addRankingRows(WindowRanking& ranking, int series, int period, ColumnTable& table)
+{
+    size_t rank = 0;
+
+    for (size_t i = 0; i < ranking.size(); i++)
+    {
+        if ( i == 0 || ranking[i].mean != ranking[i - 1].mean )
+        {
+            rank = i + 1;
+        }
+
+        table.putInt(0, series);
+        table.putInt(1, period);
+        table.putUnsigned( 2, uint32_t(rank) );
+        table.putInt( 3, int32_t( ranking[i].month_number / NUMBER_OF_MONTHS_PER_YEAR ) );
+        table.putInt( 4, int32_t( ranking[i].month_number % NUMBER_OF_MONTHS_PER_YEAR ) + 1 );
+        table.putFloat(5, ranking[i].mean);
+    }
+}
+
+// The tables out=PREFIX writes, each to PREFIX.<table>.col in the layout in
+// ColumnTable.h. Only years and months with data get rows.
+//
+//   records   year, max_records, min_records, incremental_max_records,
+//             incremental_min_records; daily archives only, every year
+//   yearly    year, series, mean, count, months
+//   monthly   year, month (1-12), series, mean, count
+//   rankings  series, period, rank, year, month, mean; the windows in report
+//             order, tied windows sharing a rank
+//   gridded   year, month, mean, cells; monthly archives with grid= only
+//
+// count is the number of daily readings, or for monthly archives the count
+// the report prints. Monthly archives only rank series 0.
+struct ExportTables
+{
+                            ExportTables();
+
+    void                    addYear(unsigned int year, int series, float mean, size_t count, int months)
+                            {
+                                yearly.putInt( 0, int32_t(year) );
+                                yearly.putInt(1, series);
+                                yearly.putFloat(2, mean);
+                                yearly.putUnsigned( 3, uint32_t(count) );
+                                yearly.putInt(4, months);
+                            }
+
+    void                    addMonth(unsigned int year, size_t month, int series, float mean, size_t count)
+                            {
+                                monthly.putInt( 0, int32_t(year) );
+                                monthly.putInt( 1, int32_t(month) + 1 );
+                                monthly.putInt(2, series);
+                                monthly.putFloat(3, mean);
+                                monthly.putUnsigned( 4, uint32_t(count) );
+                            }
+
+    // Write the tables that have rows, complaining on stderr about any that
+    // can't be written
+    void                    write(const std::string& prefix) const;
+
+    ColumnTable             records;
+    ColumnTable             yearly;
+    ColumnTable             monthly;
+    ColumnTable             rankings;
+    ColumnTable             gridded;
+};
+
+ExportTables::ExportTables()
+{
+    records.addColumn("year", COLUMN_INT32);
+    records.addColumn("max_records", COLUMN_UINT32);
+    records.addColumn("min_records", COLUMN_UINT32);
+    records.addColumn("incremental_max_records", COLUMN_UINT32);
+    records.addColumn("incremental_min_records", COLUMN_UINT32);
+
+    yearly.addColumn("year", COLUMN_INT32);
+    yearly.addColumn("series", COLUMN_INT32);
+    yearly.addColumn("mean", COLUMN_FLOAT32);
+    yearly.addColumn("count", COLUMN_UINT32);
+    yearly.addColumn("months", COLUMN_INT32);
+
+    monthly.addColumn("year", COLUMN_INT32);
+    monthly.addColumn("month", COLUMN_INT32);
+    monthly.addColumn("series", COLUMN_INT32);
+    monthly.addColumn("mean", COLUMN_FLOAT32);
+    monthly.addColumn("count", COLUMN_UINT32);
+
+    addRankingColumns(rankings);
+
+    gridded.addColumn("year", COLUMN_INT32);
+    gridded.addColumn("month", COLUMN_INT32);
+    gridded.addColumn("mean", COLUMN_FLOAT32);
+    gridded.addColumn("cells", COLUMN_UINT32);
+}
+
+void
+ExportTables::write(const std::string& prefix) const
+{
+    const ColumnTable* table_vector[] = { &records, &yearly, &monthly, &rankings, &gridded };
+    const char* name_vector[] = { "records", "yearly", "monthly", "rankings", "gridded" };
+
+    for (size_t i = 0; i < sizeof(table_vector) / sizeof(table_vector[0]); i++)
+    {
+        // An empty records or gridded table just means the archive doesn't have one
+        if ( table_vector[i]->getNumberOfRows() == 0 && (table_vector[i] == &records || table_vector[i] == &gridded) )
+        {
+            continue;
+        }
+
+        std::string file_name = prefix + "." + name_vector[i] + ".col";
+
+        if ( !table_vector[i]->write(file_name) )
+        {
+            std::cerr << "Unable to write " << file_name << std::endl;
+        }
+    }
+}
+
+// Worker for printPeriodSweep(), ranks every number_of_threads'th period.
+// With a table_vector each period's windows go into its table as well.
+template <typename Windows>
+static void
+rankPeriods(Windows* windows, const WindowOptions* options, int first_period, const std::string* title, const std::string* title_end,
+            const char* separator, std::vector<std::string>* section_vector, int series, std::vector<ColumnTable>* table_vector)
+{
+    for (int period = first_period; period <= options->last_period; period += int(options->number_of_threads))
+    {
+        WindowRanking ranking;
+        (*windows)(period, ranking);
+        ranking.rank(options->top_windows);
+
+        ReportWriter section_stream( (*section_vector)[period - options->first_period] );
+        section_stream << *title << period << *title_end << std::endl;
+        section_stream << "Rank, " << "Month, " << "Year, " << "Temperature " << std::endl;
+        ranking.print(section_stream, separator);
+
+        if (table_vector != NULL)
+        {
+            addRankingRows( ranking, series, period, (*table_vector)[period - options->first_period] );
+        }
+    }
+}
+
+// Rank the windows for every period in options, each period on whichever
+// thread gets it, then print one section per period in period order,
+// headed "<title><period><title_end>". With a ranking_table the windows are
+// added to it too, in the same order, as series.
+template <typename Windows>
+static void
+printPeriodSweep(Windows& windows, const WindowOptions& options, const std::string& title, const std::string& title_end, const char* separator,
+                 ReportWriter& out, int series, ColumnTable* ranking_table)
+{
+    StageTimer ranking_timer(STAGE_RANKING);
+    std::vector<std::string> section_vector( options.last_period - options.first_period + 1 );
+    size_t number_of_threads = std::min( options.number_of_threads, section_vector.size() );
+    std::vector<ColumnTable> table_vector( ranking_table ? section_vector.size() : 0 );
+
+    for (size_t i = 0; i < table_vector.size(); i++)
+    {
+        addRankingColumns(table_vector[i]);
+    }
+
+    std::vector<ColumnTable>* table_vector_pointer = ranking_table ? &table_vector : NULL;
+
+    if (number_of_threads <= 1)
+    {
+        WindowOptions serial_options = options;
+        serial_options.number_of_threads = 1;
+        rankPeriods(&windows, &serial_options, options.first_period, &title, &title_end, separator, &section_vector, series, table_vector_pointer);
     }
     else
     {
-        do
+        std::vector<std::thread> thread_vector;
+
+        for (size_t i = 0; i < number_of_threads; i++)
+        {
+            thread_vector.push_back( std::thread( rankPeriods<Windows>, &windows, &options, options.first_period + int(i), &title, &title_end, separator,
+                                                  &section_vector, series, table_vector_pointer ) );
+        }
+
+        for (size_t i = 0; i < number_of_threads; i++)
         {
-            unsigned int station_number = strtoul( record_string.substr(0, 6).c_str(), NULL, 10 );
-            unsigned int state_number = strtoul( record_string.substr(0, 2).c_str(), NULL, 10 );
-            std::string state_name = STATE_NAMES[state_number];
+            thread_vector[i].join();
+        }
+    }
+
+    ranking_timer.stop();
+
+    for (size_t i = 0; i < section_vector.size(); i++)
+    {
+        out << section_vector[i];
+    }
 
-            if (state_name != current_state_name)
+    for (size_t i = 0; i < table_vector.size(); i++)
+    {
+        ranking_table->append(table_vector[i]);
+    }
+}
+
+// Print the area weighted yearly and monthly means, one line per year with
+// data. A year's mean is the mean of its months, as in the plain table. With
+// export_tables the months with data go into its gridded table too.
+static void
+printGriddedMeans(const GriddedAverage& gridded_average, float cell_size_degrees, ReportWriter& out, ExportTables* export_tables)
+{
+    std::vector<float> mean_vector;
+    std::vector<unsigned int> cell_count_vector;
+    gridded_average.getMonthlyMeans(mean_vector, cell_count_vector);
+
+    out << "Area weighted mean temperature, " << cell_size_degrees << " degree cells" << std::endl;
+    out << "Year,Temperature,#Months,#Cells,Monthly temperatures" << std::endl;
+
+    for (size_t year_index = 0; year_index < gridded_average.getNumberOfYears(); year_index++)
+    {
+        const float* monthly_mean = &mean_vector[year_index * NUMBER_OF_MONTHS_PER_YEAR];
+        const unsigned int* monthly_cells = &cell_count_vector[year_index * NUMBER_OF_MONTHS_PER_YEAR];
+        float sum = 0.0f;
+        int number_of_months_with_valid_data = 0;
+        unsigned int number_of_cells = 0;
+
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            if ( monthly_cells[month] )
             {
-                std::cout << state_name << std::endl;
-                //std::cerr << state_name << std::endl;
-                current_state_name = state_name;
+                sum += monthly_mean[month];
+                number_of_months_with_valid_data++;
+                number_of_cells = std::max( number_of_cells, monthly_cells[month] );
             }
+        }
 
-            type_flag = strtoul( record_string.substr(6, 1).c_str(), NULL, 10 );
-            unsigned int year = strtoul( record_string.substr(7, 4).c_str(), NULL, 10 );
+        if (number_of_months_with_valid_data == 0)
+        {
+            continue;
+        }
 
-            if (year > most_recent_year)
+        out << gridded_average.getFirstYear() + year_index << "," << sum / (float)number_of_months_with_valid_data;
+        out << "," << number_of_months_with_valid_data << "," << number_of_cells;
+
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            out << "," << monthly_mean[month];
+
+            if ( export_tables != NULL && monthly_cells[month] )
             {
-                most_recent_year = year;
+                ColumnTable& gridded = export_tables->gridded;
+                gridded.putInt( 0, int32_t( gridded_average.getFirstYear() + year_index ) );
+                gridded.putInt( 1, int32_t(month) + 1 );
+                gridded.putFloat(2, monthly_mean[month]);
+                gridded.putUnsigned(3, monthly_cells[month]);
             }
+        }
 
-            size_t position = 12;
+        out << std::endl;
+    }
+}
 
+// Read a monthly archive with record_source and print the yearly means and
+// the hottest rolling periods to out. Only reads the data, so any number of
+// queries can run over the same mapping at once. With a selected_station_vector
+// (sorted COOP IDs) every other station's lines are skipped. With grid= the
+// area weighted means over station_catalog's cells are printed as well. With
+// out= the tables are exported too, see ExportTables.
+static void
+parseMonthlyArchive(const RecordSource& record_source, const char* data, size_t size, const std::string& input_file_name_string,
+                    const StationCatalog& station_catalog, const QueryOptions& options, const std::vector<unsigned int>* selected_station_vector,
+                    size_t number_of_threads, ReportWriter& out)
+{
+    // Sums and counts only cover the years that turn up in the file
+    MonthlyTotals monthly_totals;
+    MonthlyTotals fabricated_monthly_totals;
+    MonthlyTotals non_fabricated_monthly_totals;
+    GriddedAverage gridded_average;
+    bool use_grid = (options.grid_cell_degrees > 0.0f);
+
+    if (use_grid)
+    {
+        gridded_average.build(station_catalog, options.grid_cell_degrees);
+    }
 
-            for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+    std::string current_state_name = "";
+    MonthlyRecord record;
+    const char* begin = data;
+    const char* end = data + size;
+    uint64_t number_of_lines = 0;
+    uint64_t number_of_records = 0;
+    StageTimer parse_timer(STAGE_MONTHLY_PARSE);
+
+    while (begin < end)
+    {
+        const char* line_end = (const char*)memchr(begin, '\n', end - begin);
+
+        if (line_end == NULL)
+        {
+            line_end = end;
+        }
+
+        const char* line = begin;
+        size_t length = line_end - begin;
+        begin = line_end + 1;
+        number_of_lines++;
+
+        if ( !record_source.decodeMonthly(line, length, record) )
+        {
+            continue;
+        }
+
+        number_of_records++;
+
+        if (   selected_station_vector != NULL
+            && !std::binary_search( selected_station_vector->begin(), selected_station_vector->end(), record.getStationNumber() ) )
+        {
+            continue;
+        }
+
+        std::string state_name = STATE_NAMES[ record.getStateNumber() ];
+
+        if (state_name != current_state_name)
+        {
+            out << state_name << std::endl;
+            //std::cerr << state_name << std::endl;
+            current_state_name = state_name;
+        }
+
+        unsigned int year = record.getYear();
+
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            if ( ( options.month_under_test && !options.months_under_test_map[month + 1] ) || !record.isValid(month) )
             {
-                if ( ( month_under_test && !months_under_test_map[month + 1] ) || ( record_string.substr(position, 5) == "-9999" ) )
-                {
-                    position += 7;
-                    continue;
-                }
+                continue;
+            }
 
-                float temperature = (float)( strtol( record_string.substr(position, 5).c_str(), NULL, 10 ) ) / 10.0f;
+            float temperature = record.getTemperature(month);
 
-                total_monthly_temperature_sum[year][month] += temperature;
-                number_of_monthly_temperature_records[year][month]++;
+            monthly_totals.add(year, month, temperature);
+
+            if (use_grid)
+            {
+                gridded_average.add(record.getStationNumber(), year, month, temperature);
+            }
 
-                position += 7;
+            if ( !record_source.hasFabricationFlags() )
+            {
+                continue;
             }
 
-            getline(ushcn_data_file, record_string);
-        } while ( ushcn_data_file.good() );
+            if ( record.isFabricated(month) )
+            {
+                fabricated_monthly_totals.add(year, month, temperature);
+            }
+            else
+            {
+                non_fabricated_monthly_totals.add(year, month, temperature);
+            }
+        }
     }
 
+    parse_timer.stop();
+    RunStats::get().add( COUNTER_INPUT_BYTES, uint64_t(size) );
+    RunStats::get().add(COUNTER_LINES, number_of_lines);
+    RunStats::get().add(COUNTER_RECORDS, number_of_records);
+    RunStats::get().add(COUNTER_REJECTED_LINES, number_of_lines - number_of_records);
+    RunStats::get().add(COUNTER_QUERIES, 1);
 
-    std::cout << input_file_name_string << std::endl;
+    StageTimer output_timer(STAGE_OUTPUT);
+    ExportTables tables;
+    ExportTables* export_tables = options.export_prefix.empty() ? NULL : &tables;
+    out << input_file_name_string << std::endl;
 
-    if (month_under_test)
+    if (options.month_under_test)
     {
         for (size_t month = 1; month <= NUMBER_OF_MONTHS_PER_YEAR; month++)
         {
-            if (months_under_test_map[month] ) 
+            if (options.months_under_test_map[month] ) 
             {
                 switch (month)
                 {
-                    case 1 : std::cout << "January" << " "; break;
-                    case 2 : std::cout << "February" << " "; break;
-                    case 3 : std::cout << "March" << " "; break;
-                    case 4 : std::cout << "April" << " "; break;
-                    case 5 : std::cout << "May" << " "; break;
-                    case 6 : std::cout << "June" << " "; break;
-                    case 7 : std::cout << "July" << " "; break;
-                    case 8 : std::cout << "August" << " "; break;
-                    case 9 : std::cout << "September" << " "; break;
-                    case 10 : std::cout << "October" << " "; break;
-                    case 11 : std::cout << "November" << " "; break;
-                    case 12 : std::cout << "December" << " "; break;
+                    case 1 : out << "January" << " "; break;
+                    case 2 : out << "February" << " "; break;
+                    case 3 : out << "March" << " "; break;
+                    case 4 : out << "April" << " "; break;
+                    case 5 : out << "May" << " "; break;
+                    case 6 : out << "June" << " "; break;
+                    case 7 : out << "July" << " "; break;
+                    case 8 : out << "August" << " "; break;
+                    case 9 : out << "September" << " "; break;
+                    case 10 : out << "October" << " "; break;
+                    case 11 : out << "November" << " "; break;
+                    case 12 : out << "December" << " "; break;
                     default : break;
                 }
             }
@@ -202,14 +846,22 @@ void parseUSHCN_2(std::string record_string, std::ifstream& ushcn_data_file, std
     }
     else
     {
-        std::cout << "Annual mean temperature";
+        out << "Annual mean temperature";
     }
 
-    std::cout << "Year,Temperature,#Months,Count,Year,Fabricated temperature,#Months,Fabricated count,Year,NonFabricated temperature,#Months,NonFabricated count" << std::endl;
+    out << "Year,Temperature,#Months,Count,Year,Fabricated temperature,#Months,Fabricated count,Year,NonFabricated temperature,#Months,NonFabricated count" << std::endl;
 
-    std::cout << std::endl;
+    out << std::endl;
 
-    for (unsigned int year = 0; year < MAX_YEARS; year++)
+    // One pass over the years in the file. Each year's averages are printed
+    // and then added to the running totals, so every rolling window, however
+    // long, is one subtraction.
+    MonthlyWindows windows;
+    std::vector<double>& running_total_vector = windows.running_total_vector;
+    unsigned int first_year = monthly_totals.getFirstYear();
+    unsigned int last_year = first_year + (unsigned int)monthly_totals.getNumberOfYears();
+
+    for (unsigned int year = first_year; year < last_year; year++)
     {
         float monthly_sum = 0.0f;
         unsigned int monthly_count = 0;
@@ -220,1128 +872,1120 @@ void parseUSHCN_2(std::string record_string, std::ifstream& ushcn_data_file, std
         float non_fabricated_monthly_sum = 0.0f;
         unsigned int non_fabricated_monthly_count = 0;
         size_t non_fabricated_yearly_count = 0;
+        float monthly_average[NUMBER_OF_MONTHS_PER_YEAR];
+        float fabricated_monthly_average[NUMBER_OF_MONTHS_PER_YEAR];
+        float non_fabricated_monthly_average[NUMBER_OF_MONTHS_PER_YEAR];
 
         for (unsigned int month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
         {
-            if ( number_of_monthly_temperature_records[year][month] )
+            monthly_average[month] = UNKNOWN_TEMPERATURE;
+            fabricated_monthly_average[month] = UNKNOWN_TEMPERATURE;
+            non_fabricated_monthly_average[month] = UNKNOWN_TEMPERATURE;
+
+            if ( monthly_totals.getCount(year, month) )
             {
-                monthly_sum += total_monthly_temperature_sum[year][month];
-                monthly_count += number_of_monthly_temperature_records[year][month];
+                monthly_sum += monthly_totals.getSum(year, month);
+                monthly_count += monthly_totals.getCount(year, month);
                 yearly_count += monthly_count;
-                average_monthly_temperature[year][month] = total_monthly_temperature_sum[year][month] / float( number_of_monthly_temperature_records[year][month] );
+                monthly_average[month] = monthly_totals.getSum(year, month) / float( monthly_totals.getCount(year, month) );
+
+                if (export_tables != NULL)
+                {
+                    export_tables->addMonth( year, month, SERIES_ALL, monthly_average[month], monthly_totals.getCount(year, month) );
+                }
             }
 
-            if ( number_of_fabricated_monthly_temperature_records[year][month] )
+            if ( fabricated_monthly_totals.getCount(year, month) )
             {
-            	fabricated_monthly_sum += total_fabricated_monthly_temperature_sum[year][month];
-            	fabricated_monthly_count += number_of_fabricated_monthly_temperature_records[year][month];
+            	fabricated_monthly_sum += fabricated_monthly_totals.getSum(year, month);
+            	fabricated_monthly_count += fabricated_monthly_totals.getCount(year, month);
             	fabricated_yearly_count += fabricated_monthly_count;
-                average_fabricated_monthly_temperature[year][month] = total_fabricated_monthly_temperature_sum[year][month] / float( number_of_fabricated_monthly_temperature_records[year][month] );
+                fabricated_monthly_average[month] = fabricated_monthly_totals.getSum(year, month) / float( fabricated_monthly_totals.getCount(year, month) );
+
+                if (export_tables != NULL)
+                {
+                    export_tables->addMonth( year, month, SERIES_FABRICATED, fabricated_monthly_average[month], fabricated_monthly_totals.getCount(year, month) );
+                }
             }
 
-            if ( number_of_non_fabricated_monthly_temperature_records[year][month] )
+            if ( non_fabricated_monthly_totals.getCount(year, month) )
             {
-            	non_fabricated_monthly_sum += total_non_fabricated_monthly_temperature_sum[year][month];
-            	non_fabricated_monthly_count += number_of_non_fabricated_monthly_temperature_records[year][month];
+            	non_fabricated_monthly_sum += non_fabricated_monthly_totals.getSum(year, month);
+            	non_fabricated_monthly_count += non_fabricated_monthly_totals.getCount(year, month);
             	non_fabricated_yearly_count += non_fabricated_monthly_count;
-                average_non_fabricated_monthly_temperature[year][month] = total_non_fabricated_monthly_temperature_sum[year][month] / float( number_of_non_fabricated_monthly_temperature_records[year][month] );
+                non_fabricated_monthly_average[month] = non_fabricated_monthly_totals.getSum(year, month) / float( non_fabricated_monthly_totals.getCount(year, month) );
+
+                if (export_tables != NULL)
+                {
+                    export_tables->addMonth( year, month, SERIES_NON_FABRICATED, non_fabricated_monthly_average[month], non_fabricated_monthly_totals.getCount(year, month) );
+                }
             }
         }
 
 		if (monthly_count)
 		{
-			float average_temperature = monthly_sum / float(monthly_count);
-			yearly_temperature[year] = average_temperature;
-
 			float sum = 0.0f;
 			int number_of_months_with_valid_data = 0;;
 
 			for (int month = 0; month < 12; month++)
 			{
-				if ( number_of_monthly_temperature_records[year][month] )
+				if ( monthly_totals.getCount(year, month) )
 				{
-					sum += average_monthly_temperature[year][month];
+					sum += monthly_average[month];
 					number_of_months_with_valid_data++;
 				}
 			}
 
-			average_temperature = sum / (float)number_of_months_with_valid_data;
+			float average_temperature = sum / (float)number_of_months_with_valid_data;
+
+			out << year << "," << average_temperature;
+			out << "," << number_of_months_with_valid_data;
+			out << "," << yearly_count;
 
-			std::cout << year << "," << average_temperature;
-			std::cout << "," << number_of_months_with_valid_data;
-			std::cout << "," << yearly_count;
+			if (export_tables != NULL)
+			{
+				export_tables->addYear(year, SERIES_ALL, average_temperature, yearly_count, number_of_months_with_valid_data);
+			}
 		}
 
 		if (fabricated_monthly_count)
 		{
-			float average_fabricated_temperature = fabricated_monthly_sum / float(fabricated_monthly_count);
-			fabricated_yearly_temperature[year] = average_fabricated_temperature;
-
 			float sum = 0.0f;
 			int number_of_months_with_valid_fabricated_data = 0;
 
 			for (int month = 0; month < 12; month++)
 			{
-				if ( number_of_fabricated_monthly_temperature_records[year][month] )
+				if ( fabricated_monthly_totals.getCount(year, month) )
 				{
-					sum += average_fabricated_monthly_temperature[year][month];
+					sum += fabricated_monthly_average[month];
 					number_of_months_with_valid_fabricated_data++;
 				}
 			}
 
-			average_fabricated_temperature = sum / (float)number_of_months_with_valid_fabricated_data;
+			float average_fabricated_temperature = sum / (float)number_of_months_with_valid_fabricated_data;
 
-			std::cout << "," << year << "," << average_fabricated_temperature;
-			std::cout << "," << number_of_months_with_valid_fabricated_data;
-			std::cout << "," << fabricated_yearly_count;
+			out << "," << year << "," << average_fabricated_temperature;
+			out << "," << number_of_months_with_valid_fabricated_data;
+			out << "," << fabricated_yearly_count;
+
+			if (export_tables != NULL)
+			{
+				export_tables->addYear(year, SERIES_FABRICATED, average_fabricated_temperature, fabricated_yearly_count, number_of_months_with_valid_fabricated_data);
+			}
 		}
 
 		if (non_fabricated_monthly_count)
 		{
-			float average_non_fabricated_temperature = non_fabricated_monthly_sum / float(non_fabricated_monthly_count);
-			non_fabricated_yearly_temperature[year] = average_non_fabricated_temperature;
-
 			float sum = 0.0f;
 			int number_of_months_with_valid_non_fabricated_data = 0;
 
 			for (int month = 0; month < 12; month++)
 			{
-				if ( number_of_non_fabricated_monthly_temperature_records[year][month] )
+				if ( non_fabricated_monthly_totals.getCount(year, month) )
 				{
-					sum += average_non_fabricated_monthly_temperature[year][month];
+					sum += non_fabricated_monthly_average[month];
 					number_of_months_with_valid_non_fabricated_data++;
 				}
 			}
 
-			average_non_fabricated_temperature = sum / (float)number_of_months_with_valid_non_fabricated_data;
+			float average_non_fabricated_temperature = sum / (float)number_of_months_with_valid_non_fabricated_data;
+
+			out << "," << year << "," << average_non_fabricated_temperature;
+			out << "," << number_of_months_with_valid_non_fabricated_data;
+			out << "," << non_fabricated_yearly_count;
 
-			std::cout << "," << year << "," << average_non_fabricated_temperature;
-			std::cout << "," << number_of_months_with_valid_non_fabricated_data;
-			std::cout << "," << non_fabricated_yearly_count;
+			if (export_tables != NULL)
+			{
+				export_tables->addYear(year, SERIES_NON_FABRICATED, average_non_fabricated_temperature, non_fabricated_yearly_count,
+				                       number_of_months_with_valid_non_fabricated_data);
+			}
 		}
 
 		if (monthly_count || fabricated_monthly_count || non_fabricated_monthly_count)
 		{
-			std::cout << std::endl;
+			out << std::endl;
 		}
-    }
 
-    for (unsigned int year = 0; year < MAX_YEARS; year++)
-    {
         for (unsigned int month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
         {
-            if ( number_of_monthly_temperature_records[year][month] )
-            {
-                float* month_ptr = &( average_monthly_temperature[year][month] );
-                float sum = 0.0f;
-
-                for (int i = -(number_of_months_for_sequential_statistics - 1); i <= 0; i++)
-                {
-                    sum += *(month_ptr + i);
-                }
+            running_total_vector.push_back( running_total_vector.back() + monthly_average[month] );
 
-                float average = sum / float(number_of_months_for_sequential_statistics);
-                size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
-                US.getVariableMonthMeanAverageMap()[average] = month_number;
+            if ( monthly_totals.getCount(year, month) )
+            {
+                windows.month_index_vector.push_back( running_total_vector.size() - 2 );
+                windows.month_number_vector.push_back( (year * NUMBER_OF_MONTHS_PER_YEAR) + month );
             }
         }
     }
 
-    std::cout << "Hottest Maximum " << number_of_months_for_sequential_statistics << " month periods" << std::endl;
-    std::cout << "Rank, " << "Month, " << "Year, " << "Temperature " << std::endl;
-    std::map<float,size_t>::reverse_iterator variable_month_iterator = US.getVariableMonthMeanAverageMap().rbegin();
-    size_t count = 1;
+    printPeriodSweep(windows, getWindowOptions(options, number_of_threads), "Hottest Maximum ", " month periods", ",", out,
+                     SERIES_ALL, export_tables ? &tables.rankings : NULL);
 
-    for ( ; variable_month_iterator != US.getVariableMonthMeanAverageMap().rend(); variable_month_iterator++ )
+    if (use_grid)
     {
-        unsigned int year = variable_month_iterator->second / NUMBER_OF_MONTHS_PER_YEAR;
-        unsigned int month = variable_month_iterator->second % NUMBER_OF_MONTHS_PER_YEAR;
-        float temperature = variable_month_iterator->first;
+        printGriddedMeans(gridded_average, options.grid_cell_degrees, out, export_tables);
+    }
 
-        std::cout << count++ << "," << month + 1 << "," << year << "," << temperature << std::endl;
+    if (export_tables != NULL)
+    {
+        tables.write(options.export_prefix);
     }
 }
 
-void parseUSHCN_2_5(std::string record_string, std::ifstream& ushcn_data_file, std::string input_file_name_string, size_t month_under_test, size_t months_under_test, int number_of_months_for_sequential_statistics)
+// Append the months in a daily delta file to US and bring the saved record
+// search of the stations it touched up to date
+static bool
+applyDeltaFile(const std::string& delta_file_name_string, const RecordSource* forced_record_source, const StationCatalog& station_catalog, Country& US,
+               std::vector<unsigned int>& state_transition_vector, size_t& most_recent_year, RecordStateMap* record_state_map)
 {
-    Country US;
-    std::vector<State>& state_vector = US.getStateVector();
-    float total_monthly_temperature_sum[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float average_monthly_temperature[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    float yearly_temperature[MAX_YEARS];
-    unsigned int number_of_monthly_temperature_records[MAX_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-    size_t first_month = month_under_test;
-    size_t last_month = month_under_test + months_under_test - 1;
+    StageTimer timer(STAGE_DELTA);
+    MappedFile delta_file;
 
-    for (size_t i = 0; i < MAX_YEARS; i++)
+    if ( !delta_file.open(delta_file_name_string) )
     {
-        yearly_temperature[i] = 0.0f;
+        std::cerr << "Unable to open " << delta_file_name_string << std::endl;
+        return false;
+    }
 
-        for (size_t j = 0; j < NUMBER_OF_MONTHS_PER_YEAR; j++)
-        {
-            total_monthly_temperature_sum[i][j] = 0.0f;
-            number_of_monthly_temperature_records[i][j] = 0;
-            average_monthly_temperature[i][j] = UNKNOWN_TEMPERATURE;
-        }
+    const RecordSource* record_source = forced_record_source;
+
+    if (record_source == NULL)
+    {
+        record_source = detectRecordSource( delta_file.getData(), delta_file.getSize() );
     }
 
-    std::string current_state_name = "";
+    if (record_source == NULL)
+    {
+        record_source = findRecordSource("daily");
+    }
 
-    do
+    if ( !record_source->isDaily() )
     {
-        unsigned int station_number = strtoul( record_string.substr(5, 6).c_str(), NULL, 10 );
-        unsigned int state_number = strtoul( record_string.substr(5, 2).c_str(), NULL, 10 );
-        std::string state_name = STATE_NAMES[state_number];
+        std::cerr << "Delta " << delta_file_name_string << " isn't a daily archive" << std::endl;
+        return false;
+    }
 
-        if (state_name != current_state_name)
-        {
-            std::cout << state_name << std::endl;
-            //std::cerr << state_name << std::endl;
-            current_state_name = state_name;
-        }
+    std::map<unsigned int, size_t> changed_slot_map;
 
-        unsigned int year = strtoul( record_string.substr(12, 4).c_str(), NULL, 10 );
+    if ( !applyDailyDelta( *record_source, delta_file.getData(), delta_file.getSize(), station_catalog, US,
+                           state_transition_vector, most_recent_year, changed_slot_map ) )
+    {
+        return false;
+    }
 
-        if (year > most_recent_year)
+    std::vector<State>& state_vector = US.getStateVector();
+
+    for (size_t state_number = 0; state_number < state_vector.size() && record_state_map != NULL; state_number++)
+    {
+        std::vector<Station>& station_vector = state_vector[state_number].getStationVector();
+
+        for (size_t station_number = 0; station_number < station_vector.size(); station_number++)
         {
-            most_recent_year = year;
+            Station& station = station_vector[station_number];
+            std::map<unsigned int, size_t>::iterator changed_it = changed_slot_map.find( station.getStationNumber() );
+
+            if ( changed_it != changed_slot_map.end() )
+            {
+                (*record_state_map)[ station.getStationNumber() ].update(station, changed_it->second);
+            }
         }
+    }
 
-        size_t position = 17;
+    std::cerr << "Applied " << delta_file_name_string << " to " << changed_slot_map.size() << " stations" << std::endl;
+    return true;
+}
 
-        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+// Count the records and print the daily report for one query to out.
+// US is only read, so queries can run side by side on the same ingest.
+// Queries without a year or month filter are answered from record_state_map
+// when there is one. With a selected_station_vector (sorted COOP IDs) only those stations are
+// searched and averaged. With out= the tables are exported too, see
+// ExportTables.
+static void
+runDailyQuery(Country& US, size_t most_recent_year, RecordStateMap* record_state_map, const QueryOptions& options,
+              const std::vector<unsigned int>* selected_station_vector, size_t number_of_threads, ReportWriter& out)
+{
+    WindowOptions window_options = getWindowOptions(options, number_of_threads);
+    std::vector<State>& state_vector = US.getStateVector();
+    size_t state_vector_size = state_vector.size();
+
+    // Walk through all temperature records
+    RecordQuery query;
+    query.station_under_test = options.station_under_test;
+    query.year_under_test = options.year_under_test;
+    query.month_under_test = options.month_under_test;
+    query.month_to_dump = options.month_to_dump;
+    query.day_to_dump = options.day_to_dump;
+    query.year_to_dump = options.year_to_dump;
+    query.start_year_for_comparing_records = options.start_year_for_comparing_records;
+    query.most_recent_year = most_recent_year;
+
+    for (size_t month = 0; month <= NUMBER_OF_MONTHS_PER_YEAR; month++)
+    {
+        query.months_under_test[month] = options.months_under_test_map[month];
+    }
+
+    std::vector<Station*> station_pointer_vector;
+
+    for (size_t state_number = 0; state_number < state_vector_size; state_number++)
+    {
+        std::vector<Station>& station_vector = state_vector.at(state_number).getStationVector();
+
+        for (size_t station_number = 0; station_number < station_vector.size(); station_number++)
         {
-            if ( ( month_under_test && !months_under_test_map[month + 1] ) || ( record_string.substr(position, 5) == "-9999" ) )
+            if (   selected_station_vector != NULL
+                && !std::binary_search( selected_station_vector->begin(), selected_station_vector->end(),
+                                        station_vector[station_number].getStationNumber() ) )
             {
-                position += 9;
                 continue;
             }
 
-            float temperature = (float)( strtol( record_string.substr(position, 5).c_str(), NULL, 10 ) ) / 100.0f;
-            temperature = (temperature * 1.8f) + 32;
-
-            total_monthly_temperature_sum[year][month] += temperature;
-            number_of_monthly_temperature_records[year][month]++;
+            // station= only ever counts its own station
+            if ( query.station_under_test && query.station_under_test != station_vector[station_number].getStationNumber() )
+            {
+                continue;
+            }
 
-            position += 9;
+            station_pointer_vector.push_back( &station_vector.at(station_number) );
         }
+    }
 
-        getline(ushcn_data_file, record_string);
-    } while ( ushcn_data_file.good() );
+    RunStats::get().add( COUNTER_STATIONS_SEARCHED, station_pointer_vector.size() );
+    RunStats::get().add(COUNTER_QUERIES, 1);
+    StageTimer search_timer(STAGE_RECORD_SEARCH);
 
-    std::cout << input_file_name_string << std::endl;
+    std::vector< std::unique_ptr<RecordTotals> > totals_vector;
+    totals_vector.push_back( std::unique_ptr<RecordTotals>( new RecordTotals(most_recent_year) ) );
+    bool use_record_states = (record_state_map != NULL) && canUseRecordStates(query);
 
-    if (month_under_test)
+    if (number_of_threads <= 1)
     {
-        for (size_t month = 1; month <= NUMBER_OF_MONTHS_PER_YEAR; month++)
+        for (size_t i = 0; i < station_pointer_vector.size(); i++)
         {
-            if (months_under_test_map[month] ) 
+            if (use_record_states)
             {
-                switch (month)
-                {
-                    case 1 : std::cout << "January" << " "; break;
-                    case 2 : std::cout << "February" << " "; break;
-                    case 3 : std::cout << "March" << " "; break;
-                    case 4 : std::cout << "April" << " "; break;
-                    case 5 : std::cout << "May" << " "; break;
-                    case 6 : std::cout << "June" << " "; break;
-                    case 7 : std::cout << "July" << " "; break;
-                    case 8 : std::cout << "August" << " "; break;
-                    case 9 : std::cout << "September" << " "; break;
-                    case 10 : std::cout << "October" << " "; break;
-                    case 11 : std::cout << "November" << " "; break;
-                    case 12 : std::cout << "December" << " "; break;
-                    default : break;
-                }
+                addStationRecords(*station_pointer_vector[i], *record_state_map, query, *totals_vector[0], out);
+            }
+            else
+            {
+                countStationRecords(*station_pointer_vector[i], query, *totals_vector[0], out);
             }
         }
     }
     else
     {
-        std::cout << "Annual mean temperature" << std::endl;
-    }
+        // Each thread gets a contiguous run of stations, so the totals are
+        // always added up in the same order for a given thread count
+        size_t number_of_stations = station_pointer_vector.size();
+        std::vector<std::string> dump_vector(number_of_stations);
+        std::vector<std::thread> thread_vector;
 
-    for (unsigned int year = 0; year < MAX_YEARS; year++)
-    {
-        float monthly_sum = 0.0f;
-        unsigned int monthly_count = 0;
-        float monthly_average[NUMBER_OF_MONTHS_PER_YEAR];
-        float sum_of_monthly_temperatures = 0.0f;
-        size_t number_of_months = 0;
+        for (size_t i = 1; i < number_of_threads; i++)
+        {
+            totals_vector.push_back( std::unique_ptr<RecordTotals>( new RecordTotals(most_recent_year) ) );
+        }
 
-        for (unsigned int month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        for (size_t i = 0; i < number_of_threads; i++)
         {
-            if ( number_of_monthly_temperature_records[year][month] )
+            size_t first = (number_of_stations * i) / number_of_threads;
+            size_t last = (number_of_stations * (i + 1)) / number_of_threads;
+
+            if (use_record_states)
             {
-                monthly_sum += total_monthly_temperature_sum[year][month];
-                monthly_count += number_of_monthly_temperature_records[year][month];
-                average_monthly_temperature[year][month] = total_monthly_temperature_sum[year][month] / float( number_of_monthly_temperature_records[year][month] );
-                monthly_average[month] = total_monthly_temperature_sum[year][month] / number_of_monthly_temperature_records[year][month];
-                sum_of_monthly_temperatures += monthly_average[month];
-                number_of_months++;
+                thread_vector.push_back( std::thread( addRecordStatesForStations, &station_pointer_vector, first, last,
+                                                      record_state_map, &query, totals_vector[i].get(), &dump_vector ) );
+            }
+            else
+            {
+                thread_vector.push_back( std::thread( countRecordsForStations, &station_pointer_vector, first, last,
+                                                      &query, totals_vector[i].get(), &dump_vector ) );
             }
         }
 
-        if (number_of_months)
+        for (size_t i = 0; i < number_of_threads; i++)
         {
-            //float average_temperature = monthly_sum / float(monthly_count);
-            //yearly_temperature[year] = average_temperature;
-            float average_temperature = sum_of_monthly_temperatures / float(number_of_months);
-            yearly_temperature[year] = average_temperature;
+            thread_vector[i].join();
 
-            std::cout << year << ", " << average_temperature << std::endl; 
+            if (i)
+            {
+                totals_vector[0]->add( *totals_vector[i] );
+                totals_vector[i].reset();
+            }
         }
-    }
 
-    for (unsigned int year = 0; year < MAX_YEARS; year++)
-    {
-        for (unsigned int month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        for (size_t i = 0; i < number_of_stations; i++)
         {
-            if ( number_of_monthly_temperature_records[year][month] )
-            {
-                float* month_ptr = &( average_monthly_temperature[year][month] );
-                float sum = 0.0f;
-
-                for (int i = -(number_of_months_for_sequential_statistics - 1); i <= 0; i++)
-                {
-                    sum += *(month_ptr + i);
-                }
-
-                float average = sum / float(number_of_months_for_sequential_statistics);
-                size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
-                US.getVariableMonthMeanAverageMap()[average] = month_number;
-            }
+            out << dump_vector[i];
         }
     }
 
-    std::cout << "Hottest Maximum " << number_of_months_for_sequential_statistics << " month periods" << std::endl;
-    std::cout << "Rank, " << "Month, " << "Year, " << "Temperature " << std::endl;
-    std::map<float,size_t>::reverse_iterator variable_month_iterator = US.getVariableMonthMeanAverageMap().rbegin();
-    size_t count = 1;
-
-    for ( ; variable_month_iterator != US.getVariableMonthMeanAverageMap().rend(); variable_month_iterator++ )
+    search_timer.stop();
+    StageTimer output_timer(STAGE_OUTPUT);
+
+    RecordTotals& totals = *totals_vector[0];
+    YearSeries<unsigned int>& record_max_per_year = totals.record_max_per_year;
+    YearSeries<unsigned int>& record_min_per_year = totals.record_min_per_year;
+    YearSeries<unsigned int>& record_incremental_max_per_year = totals.record_incremental_max_per_year;
+    YearSeries<unsigned int>& record_incremental_min_per_year = totals.record_incremental_min_per_year;
+    YearSeries<ExactSum>& total_temperature_per_year = totals.total_temperature_per_year;
+    YearSeries<unsigned int>& number_of_readings_per_year = totals.number_of_readings_per_year;
+    YearSeries<ExactSum>& total_max_temperature_per_year = totals.total_max_temperature_per_year;
+    YearSeries<unsigned int>& number_of_max_readings_per_year = totals.number_of_max_readings_per_year;
+    YearSeries<ExactSum>& total_min_temperature_per_year = totals.total_min_temperature_per_year;
+    YearSeries<unsigned int>& number_of_min_readings_per_year = totals.number_of_min_readings_per_year;
+    unsigned int (&number_of_readings_per_month)[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR] = totals.number_of_readings_per_month;
+    unsigned int (&number_of_max_readings_per_month)[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR] = totals.number_of_max_readings_per_month;
+    unsigned int (&number_of_min_readings_per_month)[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR] = totals.number_of_min_readings_per_month;
+    ExactSum (&total_temperature_per_month)[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR] = totals.total_temperature_per_month;
+    ExactSum (&total_max_temperature_per_month)[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR] = totals.total_max_temperature_per_month;
+    ExactSum (&total_min_temperature_per_month)[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR] = totals.total_min_temperature_per_month;
+
+    // Dump out the results
+    unsigned int first_year = record_max_per_year.getFirstYear();
+    unsigned int last_year = record_max_per_year.getLastYear();
+    ExportTables tables;
+    ExportTables* export_tables = options.export_prefix.empty() ? NULL : &tables;
+
+    for (unsigned int year = first_year; year <= last_year && export_tables != NULL; year++)
     {
-        unsigned int year = variable_month_iterator->second / NUMBER_OF_MONTHS_PER_YEAR;
-        unsigned int month = variable_month_iterator->second % NUMBER_OF_MONTHS_PER_YEAR;
-        float temperature = variable_month_iterator->first;
-
-        std::cout << count++ << ", " << month + 1 << ", " << year << ", " << temperature << std::endl;
+        tables.records.putInt( 0, int32_t(year) );
+        tables.records.putUnsigned( 1, record_max_per_year[year] );
+        tables.records.putUnsigned( 2, record_min_per_year[year] );
+        tables.records.putUnsigned( 3, record_incremental_max_per_year[year] );
+        tables.records.putUnsigned( 4, record_incremental_min_per_year[year] );
     }
-}
 
-int main (int argc, char** argv) 
-{
-    if (argc < 2)
+    out << "Start year for record comparison " << options.start_year_for_comparing_records << std::endl;
+    out << "Record Maximums," << std::endl;
+    for (unsigned int year = first_year; year <= last_year; year++)
     {
-        std::cerr << "Usage : ushcn.exe USHCN_DATA_FILE_NAME [month=0-12] [year=YYYY] [date=MODY] [dump=MODYYEAR]" << std::endl;
-        return (1);
+        out << year << ", " << record_max_per_year[year] << "," << std::endl;
     }
 
-    std::string input_file_name_string = argv[1];
-
-    size_t station_under_test = 0;
-    size_t year_under_test = 0;
-    size_t month_under_test = 0;
-    size_t months_under_test = 1;
-    size_t month_to_dump = 0;
-    size_t day_to_dump = 0;
-    size_t year_to_dump = 0;
-    int number_of_months_for_sequential_statistics = 12;
-    size_t start_year_for_comparing_records = 1930;
-
-    for (int i = 2; i < argc; i++)
+    out << "Start year for record comparison " << options.start_year_for_comparing_records << std::endl;
+    out << "Record Minimums," << std::endl;
+    for (unsigned int year = first_year; year <= last_year; year++)
     {
-        std::string argument_string = std::string( argv[i] );
-
-        if ( argument_string.find("year=") != std::string::npos )
-        {
-            std::string year_string = argument_string.substr(5, 4);
-            year_under_test = (size_t)strtol(year_string.c_str(), NULL, 10);
-            std::cout << year_string << std::endl;
-            std::cerr << year_string << std::endl;
-        }
-        else if ( argument_string.find("station=") != std::string::npos )
-        {
-            std::string station_string = argument_string.substr(8, 6);
-            station_under_test = (size_t)strtol(station_string.c_str(), NULL, 10);
-            std::cout << "Station " << station_under_test << std::endl;
-            std::cerr << "Station " << station_under_test << std::endl;
-        }
-        else if ( argument_string.find("start=") != std::string::npos )
-        {
-            std::string year_string = argument_string.substr(6, 4);
-            start_year_for_comparing_records = (size_t)strtol(year_string.c_str(), NULL, 10);
-            std::cout << "Start year " << start_year_for_comparing_records << std::endl;
-            std::cerr << "Start year " << start_year_for_comparing_records << std::endl;
-        }
-        else if ( argument_string.find("month=") != std::string::npos )
-        {
-            std::string month_string = argument_string.substr(6, 2);
-            month_under_test = (size_t)strtol(month_string.c_str(), NULL, 10);
-            months_under_test_map[month_under_test] = true;
-            std::cout << "Month " << month_string << std::endl;
-            std::cerr << "Month " << month_string << std::endl;
-        }
-        else if ( argument_string.find("months=") != std::string::npos )
-        {
-            std::string months_string = argument_string.substr(7, 2);
-            months_under_test = (size_t)strtol(months_string.c_str(), NULL, 10);
-            std::cout << "Number of months " << months_under_test << std::endl;
-            std::cerr << "Number of months " << months_under_test << std::endl;
+        out << year << ", " << record_min_per_year[year] << "," << std::endl;
+    }
 
-            for (size_t i = 0; i < months_under_test; i++)
-            {
-                size_t valid_month = ( month_under_test + i ) % 12;
-                valid_month = (valid_month == 0) ? 12 : valid_month;
-                months_under_test_map[valid_month] = true;
-                std::cerr << "Month under test " << valid_month << std::endl;
-            }
-        }
-        else if ( argument_string.find("period=") != std::string::npos )
-        {
-            size_t length = argument_string.size();
-            std::string period_string = argument_string.substr(7, length - 7);
-            number_of_months_for_sequential_statistics = (int)strtol(period_string.c_str(), NULL, 10);
-            std::cout << period_string << std::endl;
-            std::cerr << period_string << std::endl;
-        }
-        else if ( argument_string.find("date=") != std::string::npos )
-        {
-            std::string dump_date_string = argument_string.substr(5, 4);
-            month_to_dump = (size_t)strtol(dump_date_string.substr(0, 2).c_str(), NULL, 10);
-            day_to_dump = (size_t)strtol(dump_date_string.substr(2, 2).c_str(), NULL, 10);
+    out << "Record Incremental Maximums," << std::endl;
+    for (unsigned int year = first_year; year <= last_year; year++)
+    {
+        out << year << ", " << record_incremental_max_per_year[year] << "," << std::endl;
+    }
 
-            if ( argument_string.size() == 13 )
-            {
-                year_to_dump = (size_t)strtol(argument_string.substr(9, 4).c_str(), NULL, 10);
-            }
-        }
+    out << "Record Incremental Minimums," << std::endl;
+    for (unsigned int year = first_year; year <= last_year; year++)
+    {
+        out << year << ", " << record_incremental_min_per_year[year] << "," << std::endl;
     }
 
-    // Read in the station information
-    std::map<unsigned int, std::string> station_name_map;
-    std::string record_string;
-    // http://cdiac.ornl.gov/ftp/ushcn_daily/ushcn-stations.txt
-    std::ifstream ushcn_station_file("ushcn-stations.txt");
+    out << "Ratio Tmax/Tmin," << std::endl;
+    for (unsigned int year = first_year; year <= last_year; year++)
+    {
+        float ratio = float( record_max_per_year[year] ) / float( record_min_per_year[year] );
+        out << year << ", " << ratio << "," << std::endl;
+    }
 
-    if ( ushcn_station_file.is_open() )
+    out << "Average temperature," << std::endl;
+    DailyWindows maximum_month_windows;
+    DailyWindows minimum_month_windows;
+    DailyWindows average_month_windows;
+    float total_temperature = 0.0f;
+    int consecutive_count = 0;
+    size_t previous_month_number = 0;
+
+    for (unsigned int year = first_year; year <= last_year; year++)
     {
-        while ( ushcn_station_file.good() )
+        float average = float( total_temperature_per_year[year] ) / float( number_of_readings_per_year[year] );
+        int number_of_months = 0;
+        out << year << ", " << average << ", " << number_of_readings_per_year[year] << ",,   ";
+
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
         {
-            getline(ushcn_station_file, record_string);
+            float monthly_average = UNKNOWN_TEMPERATURE;
+            size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
+
 
-            if (record_string.length() < 90)
+            if ( number_of_readings_per_month[year - FIRST_YEAR][month] )
             {
-                continue;
-            }
+                if ( (month_number - previous_month_number) == 1 )
+                {
+                    consecutive_count ++;
+                }
+                else
+                {
+                    consecutive_count = 0;
+                }
 
-            unsigned int station_number = strtoul( record_string.substr(0, 6).c_str(), NULL, 10 );
-            std::string station_name = record_string.substr(36, 15);
-            station_name_map[station_number] = station_name;
-        }
+                monthly_average = float( total_temperature_per_month[year - FIRST_YEAR][month] ) / number_of_readings_per_month[year - FIRST_YEAR][month];
+                number_of_months++;
 
-        ushcn_station_file.close();
-    }
-    else 
-    {
-        std::cout << "Unable to open ushcn-stations.txt" << std::endl; 
-    }
+                if (export_tables != NULL)
+                {
+                    export_tables->addMonth( year, month, SERIES_MEAN, monthly_average, number_of_readings_per_month[year - FIRST_YEAR][month] );
+                }
 
-    // read in the station data
-    // http://cdiac.ornl.gov/ftp/ushcn_daily/
-    std::ifstream ushcn_data_file( input_file_name_string.c_str() );
+                total_temperature += monthly_average;
+                average_month_windows.add(total_temperature, consecutive_count, month_number);
+                previous_month_number = month_number;
+            }
 
-    Country US;
-    unsigned int current_station_number = 0;
-    unsigned int current_state_number = 0;
-    unsigned int current_year_number = 0;
-    bool check_ushcn_2 = true;
-    bool check_ushcn_2_5 = true;
+            out << " " << monthly_average << ", ";
+        }
 
-    // Read in the temperature database
-    if ( ushcn_data_file.is_open() )
-    {
-        while ( ushcn_data_file.good() )
-        {
-            getline(ushcn_data_file, record_string);
-
-            //if ( check_ushcn_2_5 && record_string.substr(0, 3) == "USH" )
-            //{
-            //    parseUSHCN_2_5(record_string, ushcn_data_file, input_file_name_string, month_under_test, months_under_test, number_of_months_for_sequential_statistics);
-            //    return(1);
-            //}
-            //else
-            //{
-            //    check_ushcn_2_5 = false;
-            //}
-            
-            if (   ( check_ushcn_2_5 && record_string.substr(0, 3) == "USH" )
-                || ( check_ushcn_2 && record_string.substr(6, 2) != "18" && record_string.substr(6, 2) != "19" && record_string.substr(6, 2) != "20" ) 
-               )
-            {
-                parseUSHCN_2(record_string, ushcn_data_file, input_file_name_string, month_under_test, months_under_test, number_of_months_for_sequential_statistics);
-                return(1);
-            }
-            else
-            {
-                check_ushcn_2 = false;
-            }
+        out << std::endl;
+
+        if ( export_tables != NULL && number_of_readings_per_year[year] )
+        {
+            export_tables->addYear(year, SERIES_MEAN, average, number_of_readings_per_year[year], number_of_months);
+        }
+    }
 
+    printPeriodSweep(average_month_windows, window_options, "Hottest Average", " month periods ", ", ", out,
+                     SERIES_MEAN, export_tables ? &tables.rankings : NULL);
 
-            DataRecord record;
-            record.parseTemperatureRecord(record_string);
 
-            // Uncomment this if you want to see the station info printed as the file is parsed
-#if 0
-            if ( record.getYear() == most_recent_year )
-            {
-                std::cout << record.getStateName() << " " << record.getStationNumber() << " ";
-                std::cout << station_name_map[ record.getStationNumber() ];
-                std::cout << " " << record.getRecordTypeString();
-                std::cout << " " << record.getMonth();
-                std::cout << " " << record.getYear();
-                std::cout << std::endl;
-            }
-#endif
-            // Build the database
+    out << "Average maximum temperature," << std::endl;
 
-            // Look for a new state
-            if ( record.getStateNumber() != current_state_number )
-            {
-                current_state_number = record.getStateNumber();
-                std::cerr << record.getStateName() << std::endl;
-                std::cout << record.getStateName() << std::endl;
-                US.getStateVector().at(current_state_number - 1).setStateNumber(current_state_number);
-            }
+    for (unsigned int year = first_year; year <= last_year; year++)
+    {
+        float average = float( total_max_temperature_per_year[year] ) / float( number_of_max_readings_per_year[year] );
+        int number_of_months = 0;
+        out << year << ", " << average << ", " << number_of_max_readings_per_year[year] << ",,   ";
 
-            // Look for a new station
-            if ( record.getStationNumber() != current_station_number )
-            {
-                current_station_number = record.getStationNumber();
-                Station new_station;
-                new_station.setStationNumber(current_station_number);
-                new_station.setStateName( record.getStateName() );
-                new_station.setStationName( station_name_map[ record.getStationNumber() ] );
-                US.getStateVector().at(current_state_number - 1).getStationVector().push_back(new_station);
-            }
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            float monthly_average = UNKNOWN_TEMPERATURE;
+            size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
 
-            // Look for a new year
-            if ( record.getYear() != current_year_number )
+            if ( number_of_max_readings_per_month[year - FIRST_YEAR][month] )
             {
-                current_year_number = record.getYear();
-
-                if (current_year_number > most_recent_year)
+                if ( (month_number - previous_month_number) == 1 )
                 {
-                    most_recent_year = current_year_number;
+                    consecutive_count ++;
+                }
+                else
+                {
+                    consecutive_count = 0;
                 }
 
-                Year new_year;
-                new_year.setYear(current_year_number);
-                US.getStateVector().at(current_state_number - 1).getStationVector().back().getYearVector().push_back(new_year);
-            }
-
-            State& current_state = US.getStateVector().at(current_state_number - 1);
-            Station& current_station = current_state.getStationVector().back();
-            Year& current_year = current_station.getYearVector().back();
-            Month& current_month = current_year.getMonthVector().at( record.getMonth() - 1 );
+                monthly_average = float( total_max_temperature_per_month[year - FIRST_YEAR][month] ) / number_of_max_readings_per_month[year - FIRST_YEAR][month];
+                number_of_months++;
 
-            // read in the TMAX and TMIN records for each day of the month
-            if ( record.getRecordTypeString() == "TMAX" || record.getRecordTypeString() == "TMIN" )
-            {
-                for (size_t day_number = 0; day_number < MAX_DAYS_IN_MONTH; day_number++)
+                if (export_tables != NULL)
                 {
-                    float high_temperature = record.getHighTemperature(day_number);
-                    float low_temperature = record.getLowTemperature(day_number);
-                    Day& day = current_month.getDayVector().at(day_number);
-
-                    if ( record.getRecordTypeString() == "TMAX" && 
-                        high_temperature != UNKNOWN_TEMPERATURE && 
-                        high_temperature < UNREASONABLE_HIGH_TEMPERATURE )
-                    {
-                        day.setMaxTemperature(high_temperature);
-
-                        if ( high_temperature > US.getRecordMaxTemperature() )
-                        {
-                            US.setRecordMaxTemperature( high_temperature );
-                            US.setRecordMaxYear( current_year_number );
-                        }
-
-                        if ( high_temperature > current_state.getRecordMaxTemperature() )
-                        {
-                            current_state.setRecordMaxTemperature( high_temperature );
-                            current_state.setRecordMaxYear( current_year_number );
-                        }
-
-                        if ( high_temperature > current_station.getRecordMaxTemperature() )
-                        {
-                            current_station.setRecordMaxTemperature( high_temperature );
-                            current_station.setRecordMaxYear( current_year_number );
-                        }
-
-                        if ( high_temperature > current_year.getRecordMaxTemperature() )
-                        {
-                            current_year.setRecordMaxTemperature( high_temperature );
-                            current_year.setRecordMaxMonth( record.getMonth() );
-                        }
-
-                        if ( high_temperature > current_month.getRecordMaxTemperature() )
-                        {
-                            current_month.setRecordMaxTemperature( high_temperature );
-                            current_month.setRecordMaxDay( day_number + 1 );
-                        }
-                    }
-
-                    if ( record.getRecordTypeString() == "TMIN" &&
-                        low_temperature != UNKNOWN_TEMPERATURE  && 
-                        low_temperature > UNREASONABLE_LOW_TEMPERATURE )
-                    {
-                        day.setMinTemperature(low_temperature);
-
-                        if ( low_temperature < US.getRecordMinTemperature() )
-                        {
-                            US.setRecordMinTemperature( low_temperature );
-                            US.setRecordMinYear( current_year_number );
-                        }
-
-                        if ( low_temperature < current_state.getRecordMinTemperature() )
-                        {
-                            current_state.setRecordMinTemperature( low_temperature );
-                            current_state.setRecordMinYear( current_year_number );
-                        }
-
-                        if ( low_temperature < current_station.getRecordMinTemperature() )
-                        {
-                            current_station.setRecordMinTemperature( low_temperature );
-                            current_station.setRecordMinYear( current_year_number );
-                        }
-
-                        if ( low_temperature < current_year.getRecordMinTemperature() )
-                        {
-                            current_year.setRecordMinTemperature( low_temperature );
-                            current_year.setRecordMinMonth( record.getMonth() );
-                        }
-
-                        if ( low_temperature < current_month.getRecordMinTemperature() )
-                        {
-                            current_month.setRecordMinTemperature( low_temperature );
-                            current_month.setRecordMinDay( day_number );
-                        }
-                    }
+                    export_tables->addMonth( year, month, SERIES_MAXIMUM, monthly_average, number_of_max_readings_per_month[year - FIRST_YEAR][month] );
                 }
+
+                total_temperature += monthly_average;
+
+                maximum_month_windows.add(total_temperature, consecutive_count, month_number);
+                previous_month_number = month_number;
             }
+
+            out << " " << monthly_average << ", ";
         }
 
-        ushcn_data_file.close();
-
-        std::vector<State>& state_vector = US.getStateVector();
-        size_t state_vector_size = state_vector.size();
-
-        // Maps to tracks records and sums
-
-        std::map<unsigned int, unsigned int> record_max_per_year_map;
-        std::map<unsigned int, unsigned int> record_min_per_year_map;
-        std::map<unsigned int, unsigned int> record_incremental_max_per_year_map;
-        std::map<unsigned int, unsigned int> record_incremental_min_per_year_map;
-        std::map<unsigned int, float> total_temperature_per_year_map;
-        std::map<unsigned int, unsigned int> number_of_readings_per_year_map;
-        std::map<unsigned int, float> total_max_temperature_per_year_map;
-        std::map<unsigned int, unsigned int> number_of_max_readings_per_year_map;
-        std::map<unsigned int, float> total_min_temperature_per_year_map;
-        std::map<unsigned int, unsigned int> number_of_min_readings_per_year_map;
-        float total_temperature_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-        unsigned int number_of_readings_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-        float total_max_temperature_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-        unsigned int number_of_max_readings_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-        float total_min_temperature_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-        unsigned int number_of_min_readings_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
-
-        // Zero out the maps
-        for (unsigned int year = FIRST_YEAR; year <= most_recent_year; year++)
-        {
-            record_max_per_year_map[year] = 0;
-            record_min_per_year_map[year] = 0;
-            record_incremental_max_per_year_map[year] = 0;
-            record_incremental_min_per_year_map[year] = 0;
-            total_temperature_per_year_map[year] = 0.0f;
-            total_max_temperature_per_year_map[year] = 0.0f;
-            total_min_temperature_per_year_map[year] = 0.0f;
-            number_of_readings_per_year_map[year] = 0;
-            number_of_max_readings_per_year_map[year] = 0;
-            number_of_min_readings_per_year_map[year] = 0;
-
-            for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
-            {
-                total_temperature_per_month[year - FIRST_YEAR][month] = 0.0f;
-                number_of_readings_per_month[year - FIRST_YEAR][month] = 0;
-                total_max_temperature_per_month[year - FIRST_YEAR][month] = 0.0f;
-                number_of_max_readings_per_month[year - FIRST_YEAR][month] = 0;
-                total_min_temperature_per_month[year - FIRST_YEAR][month] = 0.0f;
-                number_of_min_readings_per_month[year - FIRST_YEAR][month] = 0;
-            }
+        out << std::endl;
+
+        if ( export_tables != NULL && number_of_max_readings_per_year[year] )
+        {
+            export_tables->addYear(year, SERIES_MAXIMUM, average, number_of_max_readings_per_year[year], number_of_months);
         }
+    }
+
+    printPeriodSweep(maximum_month_windows, window_options, "Hottest Maximum", " month periods ", ", ", out,
+                     SERIES_MAXIMUM, export_tables ? &tables.rankings : NULL);
+
+    out << "Average minimum temperature," << std::endl;
+
+    for (unsigned int year = first_year; year <= last_year; year++)
+    {
+        float average = float( total_min_temperature_per_year[year] ) / float( number_of_min_readings_per_year[year] );
+        int number_of_months = 0;
+        out << year << ", " << average << ", " << number_of_min_readings_per_year[year] << ",,   ";
 
-        // Walk through all temperature records
-        for (size_t state_number = 0; state_number < state_vector_size; state_number++)
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
         {
-            std::vector<Station>& station_vector = state_vector.at(state_number).getStationVector();
-            size_t station_vector_size = station_vector.size();
+            float monthly_average = UNKNOWN_TEMPERATURE;
+            size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
 
-            for (size_t station_number = 0; station_number < station_vector_size; station_number++)
+            if ( number_of_min_readings_per_month[year - FIRST_YEAR][month] )
             {
-                std::vector<Year>& year_vector = station_vector.at(station_number).getYearVector();
-                size_t year_vector_size = year_vector.size();
-
-                if ( start_year_for_comparing_records && !month_under_test && !station_under_test && !month_to_dump &&
-                     (   !year_vector_size 
-                       || year_vector.at(0).getYear() > start_year_for_comparing_records 
-                       || year_vector.at(year_vector_size - 1).getYear() < most_recent_year 
-                     )
-                   )
+                if ( (month_number - previous_month_number) == 1 )
                 {
-                    continue;
+                    consecutive_count ++;
                 }
-
-                std::map<unsigned int, unsigned int> station_record_max_per_year_map;
-                std::map<unsigned int, unsigned int> station_record_min_per_year_map;
-
-                size_t station = station_vector.at(station_number).getStationNumber();
-
-                if ( station_under_test && (station_under_test != station) )
+                else
                 {
-                    continue;
+                    consecutive_count = 0;
                 }
 
+                monthly_average = float( total_min_temperature_per_month[year - FIRST_YEAR][month] ) / number_of_min_readings_per_month[year - FIRST_YEAR][month];
+                number_of_months++;
 
-                float record_max_temperatures[NUMBER_OF_MONTHS_PER_YEAR][MAX_DAYS_IN_MONTH];
-                float record_min_temperatures[NUMBER_OF_MONTHS_PER_YEAR][MAX_DAYS_IN_MONTH];
-                std::vector<unsigned int> record_max_temperature_year_vector[NUMBER_OF_MONTHS_PER_YEAR][MAX_DAYS_IN_MONTH];
-                std::vector<unsigned int> record_min_temperature_year_vector[NUMBER_OF_MONTHS_PER_YEAR][MAX_DAYS_IN_MONTH];
-
-                for (size_t i = 0; i < NUMBER_OF_MONTHS_PER_YEAR; i++)
+                if (export_tables != NULL)
                 {
-                    for (size_t j = 0; j < MAX_DAYS_IN_MONTH; j++)
-                    {
-                        record_max_temperatures[i][j] = float(INT_MIN);
-                        record_min_temperatures[i][j] = float(INT_MAX);
-                    }
+                    export_tables->addMonth( year, month, SERIES_MINIMUM, monthly_average, number_of_min_readings_per_month[year - FIRST_YEAR][month] );
                 }
 
-                for (size_t year_number = 0; year_number < year_vector_size; year_number++)
-                {
-                    std::vector<Month>& month_vector = year_vector.at(year_number).getMonthVector();
-                    size_t month_vector_size = month_vector.size();
-                    unsigned int year = year_vector.at(year_number).getYear();
-
-                    if ( year_under_test && (year_under_test != year) )
-                    {
-                        continue;
-                    }
-
-                    for (size_t month_number = 0; month_number < month_vector_size; month_number++)
-                    {
-                        std::vector<Day>& day_vector = month_vector.at(month_number).getDayVector();
-                        size_t day_vector_size = day_vector.size();
-
-                        if ( month_under_test && !months_under_test_map[month_number + 1] )
-                        {
-                            continue;
-                        }
-
-                        for (size_t day_number = 0; day_number < day_vector_size; day_number++)
-                        {
-                            Day& day = day_vector.at(day_number);
-                            float max_temperature = day.getMaxTemperature();
-                            float min_temperature = day.getMinTemperature();
-
-                            if ( (year_to_dump == year) && ( month_to_dump == (month_number + 1) ) && ( day_to_dump == (day_number + 1) )  &&
-                                 (max_temperature != UNKNOWN_TEMPERATURE) && ( min_temperature != UNKNOWN_TEMPERATURE) )
-                            {
-                                std::cout << std::setw(15) << station_vector.at(station_number).getStateName() << ",  ";
-                                std::cout << station_vector.at(station_number).getStationName() << ", " << month_to_dump << "/" << day_to_dump;
-                                std::cout << "/" << year;
-                                std::cout << ", " << std::setw(3) << max_temperature << ", " << std::setw(3) << min_temperature << std::endl;
-                            }
+                total_temperature += monthly_average;
 
-                            // Don't use broken readings
-                            if (max_temperature != UNKNOWN_TEMPERATURE  && max_temperature < UNREASONABLE_HIGH_TEMPERATURE)
-                            {
-                                total_temperature_per_year_map[year] = total_temperature_per_year_map[year] + max_temperature;
-                                number_of_readings_per_year_map[year] = number_of_readings_per_year_map[year] + 1;
-                                total_temperature_per_month[year - FIRST_YEAR][month_number] += max_temperature;
-                                number_of_readings_per_month[year - FIRST_YEAR][month_number]++;
-                                total_max_temperature_per_month[year - FIRST_YEAR][month_number] += max_temperature;
-                                number_of_max_readings_per_month[year - FIRST_YEAR][month_number]++;
-                                total_max_temperature_per_year_map[year] = total_max_temperature_per_year_map[year] + max_temperature;
-                                number_of_max_readings_per_year_map[year] = number_of_max_readings_per_year_map[year] + 1;
-
-                                if ( max_temperature == record_max_temperatures[month_number][day_number] )
-                                {
-                                    record_max_temperature_year_vector[month_number][day_number].push_back(year);
-                                }
+                minimum_month_windows.add(total_temperature, consecutive_count, month_number);
+                previous_month_number = month_number;
+            }
 
-                                if ( max_temperature > record_max_temperatures[month_number][day_number] )
-                                {
-                                    record_max_temperatures[month_number][day_number] = max_temperature;
-                                    record_incremental_max_per_year_map[year] = record_incremental_max_per_year_map[year] + 1;
+            out << " " << monthly_average << ", ";
+        }
 
-                                    std::vector<unsigned int>& record_max_vector = record_max_temperature_year_vector[month_number][day_number];
-                                    record_max_vector.erase( record_max_vector.begin(), record_max_vector.end() );
-                                    record_max_vector.push_back(year);
-                                }
-                            }
+        out << std::endl;
 
-                            if (min_temperature != UNKNOWN_TEMPERATURE  && min_temperature > UNREASONABLE_LOW_TEMPERATURE)
-                            {
-                                total_temperature_per_year_map[year] = total_temperature_per_year_map[year] + min_temperature;
-                                number_of_readings_per_year_map[year] = number_of_readings_per_year_map[year] + 1;
-                                total_temperature_per_month[year - FIRST_YEAR][month_number] += min_temperature;
-                                number_of_readings_per_month[year - FIRST_YEAR][month_number]++;
-                                total_min_temperature_per_month[year - FIRST_YEAR][month_number] += min_temperature;
-                                number_of_min_readings_per_month[year - FIRST_YEAR][month_number]++;
-                                total_min_temperature_per_year_map[year] = total_min_temperature_per_year_map[year] + min_temperature;
-                                number_of_min_readings_per_year_map[year] = number_of_min_readings_per_year_map[year] + 1;
-
-                                if ( min_temperature == record_min_temperatures[month_number][day_number] )
-                                {
-                                    record_min_temperature_year_vector[month_number][day_number].push_back(year);
-                                }
+        if ( export_tables != NULL && number_of_min_readings_per_year[year] )
+        {
+            export_tables->addYear(year, SERIES_MINIMUM, average, number_of_min_readings_per_year[year], number_of_months);
+        }
+    }
 
-                                if ( min_temperature < record_min_temperatures[month_number][day_number] )
-                                {
-                                    record_min_temperatures[month_number][day_number] = min_temperature;
-                                    record_incremental_min_per_year_map[year] = record_incremental_min_per_year_map[year] + 1;
+    printPeriodSweep(minimum_month_windows, window_options, "Hottest Minimum", " month periods ", ", ", out,
+                     SERIES_MINIMUM, export_tables ? &tables.rankings : NULL);
 
-                                    std::vector<unsigned int>& record_min_vector = record_min_temperature_year_vector[month_number][day_number];
-                                    record_min_vector.erase( record_min_vector.begin(), record_min_vector.end() );
-                                    record_min_vector.push_back(year);
-                                }
-                            }
-                        }
-                    }
-                }
+    if (export_tables != NULL)
+    {
+        tables.write(options.export_prefix);
+    }
+}
 
-                if ( year_vector.at(0).getYear() <= start_year_for_comparing_records && year_vector.at(year_vector_size - 1).getYear() >= most_recent_year )
-                {
-                    for (size_t i = 0; i < NUMBER_OF_MONTHS_PER_YEAR; i++)
-                    {   
-                        for (size_t j = 0; j < MAX_DAYS_IN_MONTH; j++)
-                        {
-                            if ( ( month_to_dump == (i + 1) ) && ( day_to_dump == (j + 1) ) && (year_to_dump == 0) )
-                            {
-                                std::cout << std::setw(15) << station_vector.at(station_number).getStateName() << ",  ";
-                                std::cout << station_vector.at(station_number).getStationName() << ", " << month_to_dump << "/" << day_to_dump;
-                                std::cout << ", " << std::setw(3) << record_max_temperatures[i][j] << ", ";
+// One line of a batch query file, and the file its report is written to
+struct BatchQuery
+{
+    std::string             argument_line;
+    std::string             output_file_name;
+};
 
-                                size_t size = record_max_temperature_year_vector[i][j].size();
-                                size_t k = 0;
+// The ingested data every batch or served query runs against. It is only
+// ever read, so any number of queries can share it.
+struct QueryContext
+{
+    Country*                US;
+    const StationCatalog*   station_catalog;
+    const SpatialIndex*     spatial_index;
+    size_t                  most_recent_year;
+    RecordStateMap*         record_state_map;
+    const std::vector<unsigned int>* state_transition_vector;
+    const RecordSource*     monthly_source;
+    const char*             data;
+    size_t                  size;
+    std::string             input_file_name_string;
+};
+
+// Shared by the batch workers. Queries are handed out one at a time through
+// next_query so that one slow query doesn't hold up the ones queued behind it.
+struct BatchContext
+{
+    const QueryContext*     query_context;
+    std::vector<BatchQuery>* query_vector;
+    std::atomic<size_t>     next_query;
+};
+
+// Parse one line of query arguments and write the report to out, exactly as
+// the same arguments print when run on their own. A malformed line writes
+// only the offending argument and returns false, as does out= unless
+// allow_export is set, so that clients of the server can't write files.
+static bool
+runQueryLine(const QueryContext& context, const std::string& argument_line, bool allow_export, ReportWriter& out)
+{
+    std::string echo_string;
+    ReportWriter echo_stream(echo_string);
+    QueryOptions options;
+    std::istringstream argument_stream(argument_line);
+    std::string argument_string;
 
-                                for ( ; k < size - 1; k++)
-                                {
-                                    std::cout << record_max_temperature_year_vector[i][j].at(k) << ", ";
-                                }
+    while (argument_stream >> argument_string)
+    {
+        int status = parseQueryArgument(argument_string, options, echo_stream);
 
-                                std::cout << record_max_temperature_year_vector[i][j].at(k) << std::endl;
+        if ( status < 0 || ( !allow_export && !options.export_prefix.empty() ) )
+        {
+            out << "Bad argument " << argument_string << std::endl;
+            return false;
+        }
+        else if (status == 0)
+        {
+            std::cerr << "Ignoring " << argument_string << std::endl;
+        }
+    }
 
-#if 0
-                                std::cerr << "    " << record_min_temperatures[i][j] << " : ";
+    out << echo_string;
 
-                                size = record_min_temperature_year_vector[i][j].size();
+    std::vector<unsigned int> selected_station_vector;
+    bool select = selectStations(*context.station_catalog, *context.spatial_index, options, selected_station_vector);
 
-                                for (size_t k = 0; k < size; k++)
-                                {
-                                    std::cerr << record_min_temperature_year_vector[i][j].at(k) << ", ";
-                                }
+    if (context.monthly_source != NULL)
+    {
+        parseMonthlyArchive(*context.monthly_source, context.data, context.size, context.input_file_name_string, *context.station_catalog, options,
+                            select ? &selected_station_vector : NULL, 1, out);
+    }
+    else
+    {
+        const std::vector<unsigned int>& state_transition_vector = *context.state_transition_vector;
 
-#endif
-                            }
+        for (size_t i = 0; i < state_transition_vector.size(); i++)
+        {
+            out << STATE_NAMES[ state_transition_vector[i] ] << std::endl;
+        }
 
-                            size_t size = record_max_temperature_year_vector[i][j].size();
+        runDailyQuery(*context.US, context.most_recent_year, context.record_state_map, options, select ? &selected_station_vector : NULL, 1, out);
+    }
 
-                            for (size_t k = 0; k < size; k++)
-                            {
-                                unsigned int record_max_year = record_max_temperature_year_vector[i][j].at(k);
-                                record_max_per_year_map[record_max_year] = record_max_per_year_map[record_max_year] + 1;
-                                station_record_max_per_year_map[record_max_year] = station_record_max_per_year_map[record_max_year] + 1;
-                            }
+    return true;
+}
 
-                            size = record_min_temperature_year_vector[i][j].size();
+// Answers the query server's requests from the ingested data
+class ContextQueryHandler : public QueryHandler
+{
+public:
+                            ContextQueryHandler(const QueryContext& context) : m_context(context) {}
 
-                            for (size_t k = 0; k < size; k++)
+    virtual bool            runQuery(const std::string& argument_line, std::ostream& out)
                             {
-                                unsigned int record_min_year = record_min_temperature_year_vector[i][j].at(k);
-                                record_min_per_year_map[record_min_year] = record_min_per_year_map[record_min_year] + 1;
-                                station_record_min_per_year_map[record_min_year] = station_record_min_per_year_map[record_min_year] + 1;
+                                std::string report;
+                                ReportWriter report_writer(report);
+                                bool ok = runQueryLine(m_context, argument_line, false, report_writer);
+                                out << report;
+                                return ok;
                             }
-                        }
-                    }
-                }
-            }
-        }
 
-        size_t record_map_size = record_max_per_year_map.size();
+private:
+    const QueryContext&     m_context;
+};
+
+// Read the argument lines of a batch query file. Blank lines and lines
+// starting with # are skipped, the rest are numbered from 1 and their
+// reports go to QUERY_FILE.N.out
+static bool
+readBatchQueries(const std::string& query_file_name_string, std::vector<BatchQuery>& query_vector)
+{
+    std::ifstream query_file( query_file_name_string.c_str() );
+
+    if ( !query_file.is_open() )
+    {
+        return false;
+    }
 
+    std::string line_string;
 
-        // Dump out the results
-        std::cout << "Start year for record comparison " << start_year_for_comparing_records << std::endl;
-        std::cout << "Record Maximums," << std::endl;
-        std::map<unsigned int, unsigned int>::iterator itmax = record_max_per_year_map.begin();
+    while ( getline(query_file, line_string) )
+    {
+        size_t first = line_string.find_first_not_of(" \t\r");
 
-        while ( itmax != record_max_per_year_map.end() )
+        if ( first == std::string::npos || line_string[first] == '#' )
         {
-            std::cout << itmax->first << ", " << itmax->second << "," << std::endl;
-            ++itmax;
+            continue;
         }
 
-        std::cout << "Start year for record comparison " << start_year_for_comparing_records << std::endl;
-        std::cout << "Record Minimums," << std::endl;
-        std::map<unsigned int, unsigned int>::iterator itmin = record_min_per_year_map.begin();
+        std::ostringstream output_file_name_stream;
+        output_file_name_stream << query_file_name_string << "." << ( query_vector.size() + 1 ) << ".out";
+
+        BatchQuery batch_query;
+        batch_query.argument_line = line_string;
+        batch_query.output_file_name = output_file_name_stream.str();
+        query_vector.push_back(batch_query);
+    }
+
+    return true;
+}
+
+// Batch worker. Each query gets the output it would have printed had it
+// been run on its own, written through a buffer straight to its file.
+static void
+runBatchQueries(BatchContext* context)
+{
+    std::vector<BatchQuery>& query_vector = *context->query_vector;
+
+    for (size_t i = context->next_query++; i < query_vector.size(); i = context->next_query++)
+    {
+        ReportWriter out;
 
-        while ( itmin != record_min_per_year_map.end() )
+        if ( !out.open(query_vector[i].output_file_name) )
         {
-            std::cout << itmin->first << ", " << itmin->second << "," << std::endl;
-            ++itmin;
+            std::cerr << "Unable to write " << query_vector[i].output_file_name << std::endl;
+            continue;
         }
 
-        std::cout << "Record Incremental Maximums," << std::endl;
-        itmax = record_incremental_max_per_year_map.begin();
+        if ( !runQueryLine(*context->query_context, query_vector[i].argument_line, true, out) )
+        {
+            std::cerr << "Skipping query " << (i + 1) << std::endl;
+        }
 
-        while ( itmax != record_incremental_max_per_year_map.end() )
+        if ( !out.close() )
         {
-            std::cout << itmax->first << ", " << itmax->second << "," << std::endl;
-            ++itmax;
+            std::cerr << "Unable to write " << query_vector[i].output_file_name << std::endl;
         }
+    }
+}
 
-        std::cout << "Record Incremental Minimums," << std::endl;
-        itmin = record_incremental_min_per_year_map.begin();
+// Run every query in the batch, number_of_threads at a time. Each query
+// runs single threaded, the parallelism is across queries.
+static void
+runBatch(const QueryContext& query_context, std::vector<BatchQuery>& query_vector, size_t number_of_threads)
+{
+    BatchContext context;
+    context.query_context = &query_context;
+    context.query_vector = &query_vector;
+    context.next_query = 0;
+
+    size_t number_of_queries = query_vector.size();
+    number_of_threads = std::min(number_of_threads, number_of_queries);
+
+    if (number_of_threads <= 1)
+    {
+        runBatchQueries(&context);
+    }
+    else
+    {
+        std::vector<std::thread> thread_vector;
 
-        while ( itmin != record_incremental_min_per_year_map.end() )
+        for (size_t i = 0; i < number_of_threads; i++)
         {
-            std::cout << itmin->first << ", " << itmin->second << "," << std::endl;
-            ++itmin;
+            thread_vector.push_back( std::thread( runBatchQueries, &context ) );
         }
 
-        std::cout << "Ratio Tmax/Tmin," << std::endl;
-        itmax = record_max_per_year_map.begin();
-        itmin = record_min_per_year_map.begin();
-
-        while ( itmin != record_min_per_year_map.end() && itmax != record_max_per_year_map.end() )
+        for (size_t i = 0; i < number_of_threads; i++)
         {
-            float ratio = float(itmax->second) / float(itmin->second);
-            std::cout << itmin->first << ", " << ratio << "," << std::endl;
-            ++itmax;
-            ++itmin;
+            thread_vector[i].join();
         }
+    }
 
-        std::cout << "Average temperature," << std::endl;
-        std::map<unsigned int, float>::iterator temperature_it = total_temperature_per_year_map.begin();
-        std::map<unsigned int, unsigned int>::iterator count_it = number_of_readings_per_year_map.begin();
-        std::vector<float> maximum_month_running_total_vector;
-        std::vector<float> minimum_month_running_total_vector;
-        std::vector<float> average_month_running_total_vector;
-        float total_temperature = 0.0f;
-        int consecutive_count = 0;
-        size_t previous_month_number = 0;
+    std::cerr << "Ran " << number_of_queries << " queries" << std::endl;
+}
 
-        while ( temperature_it != total_temperature_per_year_map.end() && count_it != number_of_readings_per_year_map.end() )
-        {
-            float average = float(temperature_it->second) / float(count_it->second);
-            std::cout << temperature_it->first << ", " << average << ", " << count_it->second << ",,   ";
+// Hand the ingested data to the batch runner or the query server, whichever
+// was asked for. Returns the exit code.
+static int
+runQueryMode(const QueryContext& query_context, std::vector<BatchQuery>& batch_query_vector, const std::string& serve_address_string,
+             size_t number_of_threads)
+{
+    if ( !serve_address_string.empty() )
+    {
+        ContextQueryHandler handler(query_context);
+        return runQueryServer(serve_address_string, handler) ? 0 : 1;
+    }
+
+    runBatch(query_context, batch_query_vector, number_of_threads);
+    return 0;
+}
 
-            unsigned int year = temperature_it->first;
+int main (int argc, char** argv) 
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage : ushcn.exe USHCN_DATA_FILE_NAME [month=0-12] [year=YYYY] [date=MODY] [dump=MODYYEAR] [threads=N, 0 for all cores] [cache=SNAPSHOT_FILE] [format=daily|v2|v2.5] [storage=float|int16] [top=K, 0 for every distinct mean] [periods=FIRST..LAST] [near=LAT,LON,RADIUS_KM] [bbox=MIN_LAT,MIN_LON,MAX_LAT,MAX_LON] [grid=CELL_DEGREES] [batch=QUERY_FILE] [serve[=PORT|SOCKET_PATH]] [delta=DAILY_FILE] [stats=1|JSON_FILE] [report=REPORT_FILE] [out=TABLE_PREFIX]" << std::endl;
+        return (1);
+    }
 
-            for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
-            {
-                float monthly_average = UNKNOWN_TEMPERATURE;
-                size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
+    std::string input_file_name_string = argv[1];
 
+    // Declared first so that it reports last, whichever way main returns
+    RunStatsReport run_stats_report;
+
+    // Everything the run prints goes through report_writer, to stdout or to
+    // the report= file. The query arguments are echoed at the top of the
+    // report, once the argument that picks its file has been seen.
+    ReportWriter report_writer(stdout);
+    std::string echo_string;
+    ReportWriter echo_writer(echo_string);
+    QueryOptions options;
+    size_t number_of_threads = 1;
+    std::string cache_file_name_string;
+    std::string batch_file_name_string;
+    std::string serve_address_string;
+    std::string delta_file_name_string;
+    const RecordSource* forced_record_source = NULL;
+    bool compact_storage = false;
 
-                if ( number_of_readings_per_month[year - FIRST_YEAR][month] )
-                {
-                    if ( (month_number - previous_month_number) == 1 )
-                    {
-                        consecutive_count ++;
-                    }
-                    else
-                    {
-                        consecutive_count = 0;
-                    }
-
-                    monthly_average = total_temperature_per_month[year - FIRST_YEAR][month] / number_of_readings_per_month[year - FIRST_YEAR][month];
-                    total_temperature += monthly_average;
-                    average_month_running_total_vector.push_back(total_temperature);
-
-                    if (consecutive_count >= number_of_months_for_sequential_statistics)
-                    {
-                        size_t size = average_month_running_total_vector.size();
-                        float total_variable_month_temperature = average_month_running_total_vector.at(size - 1) - average_month_running_total_vector.at(size - 1 - number_of_months_for_sequential_statistics);
-                        float average_temperature = total_variable_month_temperature / float(number_of_months_for_sequential_statistics);
-                        US.getVariableMonthMeanAverageMap()[average_temperature] = month_number;
-                    }
-
-                    previous_month_number = month_number;
-                }
+    for (int i = 2; i < argc; i++)
+    {
+        std::string argument_string = std::string( argv[i] );
+
+        if ( argument_string.find("threads=") != std::string::npos )
+        {
+            // Parsed signed, so a negative count can't wrap round to a huge one
+            std::string threads_string = argument_string.substr(8, argument_string.size() - 8);
+            char* end = NULL;
+            long threads = strtol(threads_string.c_str(), &end, 10);
 
-                std::cout << " " << monthly_average << ", ";
+            if ( end == threads_string.c_str() || *end != '\0' || threads < 0 || threads > MAX_THREADS )
+            {
+                std::cerr << "Bad argument " << argument_string << std::endl;
+                return (1);
             }
 
-            std::cout << std::endl;
+            number_of_threads = size_t(threads);
+
+            if (number_of_threads == 0)
+            {
+                number_of_threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
 
-            temperature_it++;
-            count_it++;
+            std::cerr << "Threads " << number_of_threads << std::endl;
         }
+        else if ( argument_string.find("format=") != std::string::npos )
+        {
+            std::string format_string = argument_string.substr(7, argument_string.size() - 7);
+            forced_record_source = findRecordSource(format_string);
 
-        std::cout << "Hottest Average" << number_of_months_for_sequential_statistics << " month periods " << std::endl;
-        std::cout << "Rank, " << "Month, " << "Year, " << "Temperature " << std::endl;
-        std::map<float,size_t>::reverse_iterator variable_month_iterator = US.getVariableMonthMeanAverageMap().rbegin();
-        size_t count = 1;
+            if (forced_record_source == NULL)
+            {
+                std::cerr << "Unknown format " << format_string << std::endl;
+                return (1);
+            }
 
-        for ( ; variable_month_iterator != US.getVariableMonthMeanAverageMap().rend(); variable_month_iterator++ )
+            std::cerr << "Format " << format_string << std::endl;
+        }
+        else if ( argument_string.find("storage=") != std::string::npos )
         {
-            unsigned int year = variable_month_iterator->second / NUMBER_OF_MONTHS_PER_YEAR;
-            unsigned int month = variable_month_iterator->second % NUMBER_OF_MONTHS_PER_YEAR;
-            float temperature = variable_month_iterator->first;
+            // int16 keeps the daily readings as the whole degrees they are,
+            // float is the original layout. The monthly archives don't use it.
+            std::string storage_string = argument_string.substr(8, argument_string.size() - 8);
 
-            std::cout << count++ << ", " << month + 1 << ", " << year << ", " << temperature << std::endl;
-        }
+            if (storage_string != "int16" && storage_string != "float")
+            {
+                std::cerr << "Unknown storage " << storage_string << std::endl;
+                return (1);
+            }
 
+            compact_storage = (storage_string == "int16");
+            std::cerr << "Storage " << storage_string << std::endl;
+        }
+        else if ( argument_string.find("cache=") != std::string::npos )
+        {
+            cache_file_name_string = argument_string.substr(6, argument_string.size() - 6);
+            std::cerr << "Cache " << cache_file_name_string << std::endl;
+        }
+        else if ( argument_string.find("batch=") != std::string::npos )
+        {
+            batch_file_name_string = argument_string.substr(6, argument_string.size() - 6);
+            std::cerr << "Batch " << batch_file_name_string << std::endl;
+        }
+        else if ( argument_string.find("stats=") != std::string::npos )
+        {
+            run_stats_report.setDestination( argument_string.substr(6, argument_string.size() - 6) );
+        }
+        else if ( argument_string.find("report=") != std::string::npos )
+        {
+            std::string report_file_name_string = argument_string.substr(7, argument_string.size() - 7);
 
-        std::cout << "Average maximum temperature," << std::endl;
-        temperature_it = total_max_temperature_per_year_map.begin();
-        count_it = number_of_max_readings_per_year_map.begin();
+            if ( !report_writer.open(report_file_name_string) )
+            {
+                std::cerr << "Unable to write " << report_file_name_string << std::endl;
+                return (1);
+            }
 
-        while ( temperature_it != total_max_temperature_per_year_map.end() && count_it != number_of_max_readings_per_year_map.end() )
+            std::cerr << "Report " << report_file_name_string << std::endl;
+        }
+        else if ( argument_string.find("delta=") != std::string::npos )
+        {
+            delta_file_name_string = argument_string.substr(6, argument_string.size() - 6);
+            std::cerr << "Delta " << delta_file_name_string << std::endl;
+        }
+        else if ( argument_string == "serve" || argument_string.find("serve=") != std::string::npos )
         {
-            float average = float(temperature_it->second) / float(count_it->second);
-            std::cout << temperature_it->first << ", " << average << ", " << count_it->second << ",,   ";
+            serve_address_string = (argument_string == "serve") ? "ushcn.sock" : argument_string.substr(6, argument_string.size() - 6);
+        }
+        else if ( parseQueryArgument(argument_string, options, echo_writer) < 0 )
+        {
+            report_writer << echo_string;
+            return (1);
+        }
+    }
 
-            unsigned int year = temperature_it->first;
+    report_writer << echo_string;
 
-            for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
-            {
-                float monthly_average = UNKNOWN_TEMPERATURE;
-                size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
+    // In batch and serve modes the command line only picks the data, the
+    // queries come from the query file or the server's clients
+    std::vector<BatchQuery> batch_query_vector;
+    bool query_mode = !batch_file_name_string.empty() || !serve_address_string.empty();
 
-                if ( number_of_max_readings_per_month[year - FIRST_YEAR][month] )
-                {
-                    if ( (month_number - previous_month_number) == 1 )
-                    {
-                        consecutive_count ++;
-                    }
-                    else
-                    {
-                        consecutive_count = 0;
-                    }
-
-                    monthly_average = total_max_temperature_per_month[year - FIRST_YEAR][month] / number_of_max_readings_per_month[year - FIRST_YEAR][month];
-                    total_temperature += monthly_average;
-
-                    maximum_month_running_total_vector.push_back(total_temperature);
-
-                    if (consecutive_count >= number_of_months_for_sequential_statistics)
-                    {
-                        size_t size = maximum_month_running_total_vector.size();
-                        float total_variable_month_temperature = maximum_month_running_total_vector.at(size - 1) - maximum_month_running_total_vector.at(size - 1 - number_of_months_for_sequential_statistics);
-                        float average_temperature = total_variable_month_temperature / float(number_of_months_for_sequential_statistics);
-                        US.getVariableMonthMeanMaximumMap()[average_temperature] = month_number;
-                    }
-
-                    previous_month_number = month_number;
-                }
+    if ( !batch_file_name_string.empty() && !readBatchQueries(batch_file_name_string, batch_query_vector) )
+    {
+        std::cerr << "Unable to open " << batch_file_name_string << std::endl;
+        return (1);
+    }
 
-                std::cout << " " << monthly_average << ", ";
-            }
+    QueryContext query_context;
+    query_context.US = NULL;
+    query_context.station_catalog = NULL;
+    query_context.spatial_index = NULL;
+    query_context.most_recent_year = 0;
+    query_context.record_state_map = NULL;
+    query_context.state_transition_vector = NULL;
+    query_context.monthly_source = NULL;
+    query_context.data = NULL;
+    query_context.size = 0;
+    query_context.input_file_name_string = input_file_name_string;
 
-            std::cout << std::endl;
+    // Read in the station information
+    // http://cdiac.ornl.gov/ftp/ushcn_daily/ushcn-stations.txt
+    StationCatalog station_catalog;
 
-            temperature_it++;
-            count_it++;
-        }
+    if ( !station_catalog.load("ushcn-stations.txt") )
+    {
+        report_writer << "Unable to open ushcn-stations.txt" << std::endl;
+    }
 
-        std::cout << "Hottest Maximum" << number_of_months_for_sequential_statistics << " month periods " << std::endl;
-        std::cout << "Rank, " << "Month, " << "Year, " << "Temperature " << std::endl;
-        variable_month_iterator = US.getVariableMonthMeanMaximumMap().rbegin();
-        count = 1;
+    // Only the near= and bbox= filters search it, but it is cheap to build
+    SpatialIndex spatial_index;
+    spatial_index.build(station_catalog);
+    query_context.station_catalog = &station_catalog;
+    query_context.spatial_index = &spatial_index;
 
-        for ( ; variable_month_iterator != US.getVariableMonthMeanMaximumMap().rend(); variable_month_iterator++ )
-        {
-            unsigned int year = variable_month_iterator->second / NUMBER_OF_MONTHS_PER_YEAR;
-            unsigned int month = variable_month_iterator->second % NUMBER_OF_MONTHS_PER_YEAR;
-            float temperature = variable_month_iterator->first;
+    std::vector<unsigned int> selected_station_vector;
+    bool select = selectStations(station_catalog, spatial_index, options, selected_station_vector);
 
-            std::cout << count++ << ", " << month + 1 << ", " << year << ", " << temperature << std::endl;
-        }
+    Country US;
+    US.setCompactStorage(compact_storage);
+    std::vector<unsigned int> state_transition_vector;
+    size_t ingest_most_recent_year = 0;
+    RecordStateMap record_state_map;
+
+    // A snapshot is only trusted if both source files, and the delta if one
+    // was applied, still have the size and modification time it was built
+    // from. With a delta, a snapshot that already has it needs nothing more,
+    // and the data file's own snapshot saves re-reading the data file.
+    SnapshotKey snapshot_key;
+    bool use_snapshot = !cache_file_name_string.empty() && getSnapshotKey(input_file_name_string, "ushcn-stations.txt", snapshot_key);
+    bool have_delta = !delta_file_name_string.empty();
+    SnapshotKey delta_snapshot_key = snapshot_key;
+
+    if ( use_snapshot && have_delta && !addDeltaToSnapshotKey(delta_file_name_string, delta_snapshot_key) )
+    {
+        use_snapshot = false;
+    }
+
+    bool delta_loaded = use_snapshot && have_delta &&
+                        readSnapshot(cache_file_name_string, delta_snapshot_key, US, state_transition_vector, ingest_most_recent_year, record_state_map);
+    bool snapshot_loaded = delta_loaded ||
+                           ( use_snapshot && readSnapshot(cache_file_name_string, snapshot_key, US, state_transition_vector, ingest_most_recent_year, record_state_map) );
+    bool snapshot_changed = false;
+    bool keep_record_states = use_snapshot || query_mode;
+
+    // read in the station data
+    // http://cdiac.ornl.gov/ftp/ushcn_daily/
+    MappedFile ushcn_data_file;
+
+    bool have_daily_data = snapshot_loaded;
 
-        std::cout << "Average minimum temperature," << std::endl;
-        temperature_it = total_min_temperature_per_year_map.begin();
-        count_it = number_of_min_readings_per_year_map.begin();
+    if (snapshot_loaded)
+    {
+        std::cerr << "Loaded snapshot " << cache_file_name_string << std::endl;
+    }
+    else
+    {
+        ushcn_data_file.open(input_file_name_string);
 
-        while ( temperature_it != total_min_temperature_per_year_map.end() && count_it != number_of_min_readings_per_year_map.end() )
+        if ( ushcn_data_file.isOpen() )
         {
-            float average = float(temperature_it->second) / float(count_it->second);
-            std::cout << temperature_it->first << ", " << average << ", " << count_it->second << ",,   ";
+            have_daily_data = true;
 
-            unsigned int year = temperature_it->first;
+            const RecordSource* record_source = forced_record_source;
 
-            for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+            if (record_source == NULL)
             {
-                float monthly_average = UNKNOWN_TEMPERATURE;
-                size_t month_number = (year * NUMBER_OF_MONTHS_PER_YEAR) + month;
+                record_source = detectRecordSource( ushcn_data_file.getData(), ushcn_data_file.getSize() );
+            }
 
-                if ( number_of_min_readings_per_month[year - FIRST_YEAR][month] )
+            if ( record_source != NULL && !record_source->isDaily() )
+            {
+                if (query_mode)
                 {
-                    if ( (month_number - previous_month_number) == 1 )
-                    {
-                        consecutive_count ++;
-                    }
-                    else
-                    {
-                        consecutive_count = 0;
-                    }
-
-                    monthly_average = total_min_temperature_per_month[year - FIRST_YEAR][month] / number_of_min_readings_per_month[year - FIRST_YEAR][month];
-                    total_temperature += monthly_average;
-
-                    minimum_month_running_total_vector.push_back(total_temperature);
-
-                    if (consecutive_count >= number_of_months_for_sequential_statistics)
-                    {
-                        size_t size = minimum_month_running_total_vector.size();
-                        float total_variable_month_temperature = minimum_month_running_total_vector.at(size - 1) - minimum_month_running_total_vector.at(size - 1 - number_of_months_for_sequential_statistics);
-                        float average_temperature = total_variable_month_temperature / float(number_of_months_for_sequential_statistics);
-                        US.getVariableMonthMeanMinimumMap()[average_temperature] = month_number;
-                    }
-
-                    previous_month_number = month_number;
+                    query_context.monthly_source = record_source;
+                    query_context.data = ushcn_data_file.getData();
+                    query_context.size = ushcn_data_file.getSize();
+                    report_writer.flush();
+                    return runQueryMode(query_context, batch_query_vector, serve_address_string, number_of_threads);
                 }
 
-                std::cout << " " << monthly_average << ", ";
+                parseMonthlyArchive(*record_source, ushcn_data_file.getData(), ushcn_data_file.getSize(), input_file_name_string, station_catalog,
+                                    options, select ? &selected_station_vector : NULL, number_of_threads, report_writer);
+                return(1);
             }
 
-            std::cout << std::endl;
+            // An empty file has always gone down the daily path
+            if (record_source == NULL)
+            {
+                record_source = findRecordSource("daily");
+            }
 
-            temperature_it++;
-            count_it++;
-        }
+            ingest_most_recent_year = ingestDailyArchive( *record_source, ushcn_data_file.getData(), ushcn_data_file.getSize(), number_of_threads, station_catalog, US, state_transition_vector );
+            ushcn_data_file.close();
 
-        std::cout << "Hottest Minimum" << number_of_months_for_sequential_statistics << " month periods " << std::endl;
-        std::cout << "Rank, " << "Month, " << "Year, " << "Temperature " << std::endl;
-        variable_month_iterator = US.getVariableMonthMeanMinimumMap().rbegin();
-        count = 1;
+            // The record tables are built once and kept by the snapshot, so
+            // later runs and deltas can skip the search, and by batch and
+            // serve, which answer every query from them
+            if (keep_record_states)
+            {
+                buildRecordStates(US, record_state_map);
+                snapshot_changed = true;
+            }
+        }
+    }
 
-        for ( ; variable_month_iterator != US.getVariableMonthMeanMinimumMap().rend(); variable_month_iterator++ )
+    // A delta rides on top of the data file. The snapshot is written back
+    // under a key that includes the delta, so only runs naming the same
+    // delta get the data file with the delta applied.
+    if ( have_daily_data && have_delta && !delta_loaded )
+    {
+        if ( !applyDeltaFile(delta_file_name_string, forced_record_source, station_catalog, US, state_transition_vector, ingest_most_recent_year,
+                             keep_record_states ? &record_state_map : NULL) )
         {
-            unsigned int year = variable_month_iterator->second / NUMBER_OF_MONTHS_PER_YEAR;
-            unsigned int month = variable_month_iterator->second % NUMBER_OF_MONTHS_PER_YEAR;
-            float temperature = variable_month_iterator->first;
+            return (1);
+        }
+
+        snapshot_changed = true;
+    }
 
-            std::cout << count++ << ", " << month + 1 << ", " << year << ", " << temperature << std::endl;
+    // The states are listed once the delta is in, so a state that only the
+    // delta has still makes the report
+    for (size_t i = 0; i < state_transition_vector.size(); i++)
+    {
+        if (snapshot_loaded)
+        {
+            std::cerr << STATE_NAMES[ state_transition_vector[i] ] << std::endl;
         }
 
+        report_writer << STATE_NAMES[ state_transition_vector[i] ] << std::endl;
+    }
+
+    if (   use_snapshot && snapshot_changed
+        && !writeSnapshot(cache_file_name_string, have_delta ? delta_snapshot_key : snapshot_key, US, state_transition_vector, ingest_most_recent_year,
+                          record_state_map) )
+    {
+        std::cerr << "Unable to write snapshot " << cache_file_name_string << std::endl;
+    }
 
+    // Read in the temperature database
+    if (have_daily_data)
+    {
+        if (query_mode)
+        {
+            query_context.US = &US;
+            query_context.most_recent_year = ingest_most_recent_year;
+            query_context.record_state_map = keep_record_states ? &record_state_map : NULL;
+            query_context.state_transition_vector = &state_transition_vector;
+            report_writer.flush();
+            return runQueryMode(query_context, batch_query_vector, serve_address_string, number_of_threads);
+        }
+        else
+        {
+            runDailyQuery(US, ingest_most_recent_year, use_snapshot ? &record_state_map : NULL, options, select ? &selected_station_vector : NULL,
+                          number_of_threads, report_writer);
+        }
     }
     else 
     {
-        std::cout << "Unable to open us.txt" << std::endl; 
+        report_writer << "Unable to open us.txt" << std::endl;
     }
 
     return 0;
@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// MappedFile.cpp
+// Read only memory mapped view of an input file, handed out one line at a time.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+bool
+MappedFile::open(const std::string& file_name)
+{
+    close();
+
+#ifndef _WIN32
+    int file_descriptor = ::open(file_name.c_str(), O_RDONLY);
+
+    if (file_descriptor < 0)
+    {
+        return false;
+    }
+
+    struct stat file_status;
+
+    if ( fstat(file_descriptor, &file_status) != 0 )
+    {
+        ::close(file_descriptor);
+        return false;
+    }
+
+    m_size = (size_t)file_status.st_size;
+    m_mapped = true;
+
+    if (m_size)
+    {
+        void* mapping = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+
+        if (mapping == MAP_FAILED)
+        {
+            ::close(file_descriptor);
+            m_size = 0;
+            m_mapped = false;
+            return false;
+        }
+
+        // The parsers walk the file front to back exactly once
+        madvise(mapping, m_size, MADV_SEQUENTIAL);
+        madvise(mapping, m_size, MADV_WILLNEED);
+        m_data = (const char*)mapping;
+    }
+
+    ::close(file_descriptor);
+#else
+    // No mmap here, so fall back to slurping the whole file into memory
+    FILE* file = fopen(file_name.c_str(), "rb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    m_size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* buffer = (char*)malloc(m_size + 1);
+    m_size = fread(buffer, 1, m_size, file);
+    fclose(file);
+    m_data = buffer;
+#endif
+
+    m_position = 0;
+    return true;
+}
+
+void
+MappedFile::close()
+{
+#ifndef _WIN32
+    if (m_data != NULL)
+    {
+        munmap( (void*)m_data, m_size );
+    }
+#else
+    free( (void*)m_data );
+#endif
+
+    m_data = NULL;
+    m_size = 0;
+    m_position = 0;
+    m_mapped = false;
+}
+
+bool
+MappedFile::getLine(const char*& line, size_t& length)
+{
+    if (m_position >= m_size)
+    {
+        return false;
+    }
+
+    line = m_data + m_position;
+    const char* end = (const char*)memchr(line, '\n', m_size - m_position);
+
+    if (end == NULL)
+    {
+        length = m_size - m_position;
+        m_position = m_size;
+    }
+    else
+    {
+        length = end - line;
+        m_position += length + 1;
+    }
+
+    return true;
+}
@@ -0,0 +1,40 @@
+//--------------------------------------------------------------------------------------
+// MappedFile.h
+// Read only memory mapped view of an input file, handed out one line at a time.
+// Lines are spans into the mapping, so nothing is copied while scanning.
+
+#ifndef MAPPED_FILE_H_INCLUDED
+#define MAPPED_FILE_H_INCLUDED
+
+#include <string>
+#include <stddef.h>
+
+class MappedFile
+{
+public:
+                            MappedFile() : m_data(NULL), m_size(0), m_position(0), m_mapped(false) {}
+                            ~MappedFile() { close(); }
+
+    bool                    open(const std::string& file_name);
+    void                    close();
+    bool                    isOpen() { return m_data != NULL || m_mapped; }
+    const char*             getData() { return m_data; }
+    size_t                  getSize() { return m_size; }
+    size_t                  getPosition() { return m_position; }
+    void                    setPosition(size_t value) { m_position = (value < m_size) ? value : m_size; }
+
+    // Hand out the next line without its terminating newline.
+    // Returns false once the end of the file has been reached.
+    bool                    getLine(const char*& line, size_t& length);
+
+private:
+                            MappedFile(const MappedFile&);
+    MappedFile&             operator=(const MappedFile&);
+
+    const char*             m_data;
+    size_t                  m_size;
+    size_t                  m_position;
+    bool                    m_mapped;
+};
+
+#endif // MAPPED_FILE_H_INCLUDED
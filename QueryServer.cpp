@@ -0,0 +1,341 @@
+//--------------------------------------------------------------------------------------
+// QueryServer.cpp
+// Socket handling, request framing and latency metrics for the query server
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "QueryServer.h"
+
+// Latencies are kept in power of two microsecond buckets, which is plenty
+// to read percentiles off without keeping every sample
+static const size_t         NUMBER_OF_LATENCY_BUCKETS = 40;
+
+// Longest query line a client may send, so one that never sends a newline
+// can't grow the connection's buffer without bound
+static const size_t         MAX_LINE_LENGTH = 64 * 1024;
+
+// Request counts and latencies across every connection
+class ServerStats
+{
+public:
+                            ServerStats() : m_connections(0), m_requests(0), m_errors(0), m_total_microseconds(0), m_max_microseconds(0)
+                            {
+                                for (size_t i = 0; i < NUMBER_OF_LATENCY_BUCKETS; i++)
+                                {
+                                    m_latency_buckets[i] = 0;
+                                }
+                            }
+
+    void                    addConnection() { std::lock_guard<std::mutex> lock(m_mutex); m_connections++; }
+    void                    addRequest(uint64_t microseconds, bool ok);
+    void                    print(std::ostream& out);
+
+private:
+    uint64_t                getPercentile(double fraction);
+
+    std::mutex              m_mutex;
+    uint64_t                m_connections;
+    uint64_t                m_requests;
+    uint64_t                m_errors;
+    uint64_t                m_total_microseconds;
+    uint64_t                m_max_microseconds;
+    uint64_t                m_latency_buckets[NUMBER_OF_LATENCY_BUCKETS];
+};
+
+void
+ServerStats::addRequest(uint64_t microseconds, bool ok)
+{
+    size_t bucket = 0;
+
+    while ( (bucket + 1 < NUMBER_OF_LATENCY_BUCKETS) && ( microseconds >= (uint64_t(1) << bucket) ) )
+    {
+        bucket++;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests++;
+    m_errors += ok ? 0 : 1;
+    m_total_microseconds += microseconds;
+    m_max_microseconds = (microseconds > m_max_microseconds) ? microseconds : m_max_microseconds;
+    m_latency_buckets[bucket]++;
+}
+
+// Upper bound of the bucket holding the given fraction of requests, but
+// never more than the slowest request seen. Called with the mutex held.
+uint64_t
+ServerStats::getPercentile(double fraction)
+{
+    uint64_t target = uint64_t( fraction * double(m_requests) + 0.5 );
+    uint64_t seen = 0;
+
+    for (size_t bucket = 0; bucket < NUMBER_OF_LATENCY_BUCKETS; bucket++)
+    {
+        seen += m_latency_buckets[bucket];
+
+        if (seen >= target && seen)
+        {
+            uint64_t bound = uint64_t(1) << bucket;
+            return (bound < m_max_microseconds) ? bound : m_max_microseconds;
+        }
+    }
+
+    return 0;
+}
+
+void
+ServerStats::print(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    out << "connections " << m_connections << std::endl;
+    out << "requests " << m_requests << std::endl;
+    out << "errors " << m_errors << std::endl;
+    out << "latency_us_mean " << ( m_requests ? (m_total_microseconds / m_requests) : 0 ) << std::endl;
+    out << "latency_us_p50 " << getPercentile(0.50) << std::endl;
+    out << "latency_us_p90 " << getPercentile(0.90) << std::endl;
+    out << "latency_us_p99 " << getPercentile(0.99) << std::endl;
+    out << "latency_us_max " << m_max_microseconds << std::endl;
+}
+
+// Write all of buffer, false if the client has gone away. MSG_NOSIGNAL so a
+// closed connection doesn't take the server down with SIGPIPE.
+static bool
+sendAll(int socket_descriptor, const std::string& buffer)
+{
+    size_t sent = 0;
+
+    while ( sent < buffer.size() )
+    {
+        ssize_t result = send(socket_descriptor, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+
+        if (result <= 0)
+        {
+            return false;
+        }
+
+        sent += size_t(result);
+    }
+
+    return true;
+}
+
+// Answer requests on one connection until the client hangs up or says quit
+static void
+serveConnection(int socket_descriptor, QueryHandler* handler, ServerStats* stats)
+{
+    std::string pending;
+    char buffer[4096];
+    bool open = true;
+
+    stats->addConnection();
+
+    while (open)
+    {
+        ssize_t received = recv(socket_descriptor, buffer, sizeof(buffer), 0);
+
+        if (received <= 0)
+        {
+            break;
+        }
+
+        pending.append(buffer, size_t(received));
+        size_t line_end;
+
+        while ( open && ( line_end = pending.find('\n') ) != std::string::npos )
+        {
+            std::string line = pending.substr(0, line_end);
+            pending.erase(0, line_end + 1);
+
+            if ( !line.empty() && line[line.size() - 1] == '\r' )
+            {
+                line.erase(line.size() - 1);
+            }
+
+            if ( line.find_first_not_of(" \t") == std::string::npos )
+            {
+                continue;
+            }
+
+            std::ostringstream out;
+            std::ostringstream header;
+
+            if (line == "quit")
+            {
+                open = false;
+                continue;
+            }
+            else if (line == "stats")
+            {
+                stats->print(out);
+                header << "OK " << out.str().size() << " 0" << std::endl;
+            }
+            else
+            {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                bool ok = handler->runQuery(line, out);
+                uint64_t microseconds = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+                stats->addRequest(microseconds, ok);
+
+                if (ok)
+                {
+                    header << "OK " << out.str().size() << " " << microseconds << std::endl;
+                }
+                else
+                {
+                    header << "ERR " << out.str().size() << std::endl;
+                }
+            }
+
+            open = sendAll( socket_descriptor, header.str() + out.str() );
+        }
+
+        if ( open && pending.size() > MAX_LINE_LENGTH )
+        {
+            std::string message = "Line too long\n";
+            std::ostringstream header;
+            header << "ERR " << message.size() << std::endl;
+            sendAll( socket_descriptor, header.str() + message );
+            open = false;
+        }
+    }
+
+    close(socket_descriptor);
+}
+
+// Bind and listen on address, -1 on failure
+static int
+openListeningSocket(const std::string& address)
+{
+    int socket_descriptor = -1;
+    bool is_port = !address.empty() && ( address.find_first_not_of("0123456789") == std::string::npos );
+
+    if (is_port)
+    {
+        struct sockaddr_in socket_address;
+        memset(&socket_address, 0, sizeof(socket_address));
+        socket_address.sin_family = AF_INET;
+        socket_address.sin_port = htons( (uint16_t)strtoul(address.c_str(), NULL, 10) );
+        socket_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        socket_descriptor = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+
+        if (   socket_descriptor < 0
+            || setsockopt(socket_descriptor, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+            || bind(socket_descriptor, (struct sockaddr*)&socket_address, sizeof(socket_address)) != 0 )
+        {
+            std::cerr << "Unable to bind 127.0.0.1:" << address << " : " << strerror(errno) << std::endl;
+
+            if (socket_descriptor >= 0)
+            {
+                close(socket_descriptor);
+            }
+
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_un socket_address;
+        memset(&socket_address, 0, sizeof(socket_address));
+        socket_address.sun_family = AF_UNIX;
+
+        if ( address.empty() || address.size() >= sizeof(socket_address.sun_path) )
+        {
+            std::cerr << "Bad socket path " << address << std::endl;
+            return -1;
+        }
+
+        strncpy( socket_address.sun_path, address.c_str(), sizeof(socket_address.sun_path) - 1 );
+
+        // A socket left behind by an earlier server would make bind fail.
+        // Anything else at the path is left alone, it's likely a typo.
+        struct stat path_status;
+
+        if ( lstat(address.c_str(), &path_status) == 0 )
+        {
+            if ( !S_ISSOCK(path_status.st_mode) )
+            {
+                std::cerr << "Bad socket path " << address << std::endl;
+                return -1;
+            }
+
+            unlink( address.c_str() );
+        }
+
+        socket_descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if ( socket_descriptor < 0 || bind(socket_descriptor, (struct sockaddr*)&socket_address, sizeof(socket_address)) != 0 )
+        {
+            std::cerr << "Unable to bind " << address << " : " << strerror(errno) << std::endl;
+
+            if (socket_descriptor >= 0)
+            {
+                close(socket_descriptor);
+            }
+
+            return -1;
+        }
+    }
+
+    if ( listen(socket_descriptor, 64) != 0 )
+    {
+        std::cerr << "Unable to listen on " << address << " : " << strerror(errno) << std::endl;
+        close(socket_descriptor);
+        return -1;
+    }
+
+    return socket_descriptor;
+}
+
+bool
+runQueryServer(const std::string& address, QueryHandler& handler)
+{
+    int listening_descriptor = openListeningSocket(address);
+
+    if (listening_descriptor < 0)
+    {
+        return false;
+    }
+
+    // Outlives any connection threads still running when this returns
+    static ServerStats stats;
+    std::cerr << "Serving queries on " << address << std::endl;
+
+    // A thread per connection. The handler only reads the ingested data, so
+    // connections never wait on each other.
+    while (true)
+    {
+        int socket_descriptor = accept(listening_descriptor, NULL, NULL);
+
+        if (socket_descriptor < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+
+            std::cerr << "accept failed : " << strerror(errno) << std::endl;
+            break;
+        }
+
+        std::thread( serveConnection, socket_descriptor, &handler, &stats ).detach();
+    }
+
+    close(listening_descriptor);
+    return false;
+}
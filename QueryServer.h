@@ -0,0 +1,41 @@
+//--------------------------------------------------------------------------------------
+// QueryServer.h
+// Long running query server. The data is ingested once and then queries are
+// answered over a Unix domain socket or a localhost TCP port until the
+// process is killed.
+//
+// The protocol is line oriented. A client sends one query per line, the same
+// arguments the command line takes (e.g. "station=011084 start=1930"), and
+// gets back a header line followed by the report:
+//
+//   OK <report bytes> <microseconds>\n<report>
+//   ERR <message bytes>\n<message>
+//
+// Besides queries a client can send "stats" for the server's request counts
+// and latency figures (in the same OK framing), or "quit" to hang up. A line
+// longer than 64 KiB gets an ERR and the connection is closed.
+
+#ifndef QUERY_SERVER_H_INCLUDED
+#define QUERY_SERVER_H_INCLUDED
+
+#include <string>
+#include <ostream>
+
+// Runs one query. Called from a thread per connection, so it must only read
+// shared data.
+class QueryHandler
+{
+public:
+    virtual                 ~QueryHandler() {}
+
+    // Write the report for argument_line to out. Returns false, with the
+    // reason in out, if the query is malformed.
+    virtual bool            runQuery(const std::string& argument_line, std::ostream& out) = 0;
+};
+
+// Serve queries on address, a port number for 127.0.0.1 or otherwise the path
+// of a Unix domain socket. Only returns, false, if the socket can't be set up
+// or stops accepting connections.
+bool runQueryServer(const std::string& address, QueryHandler& handler);
+
+#endif // QUERY_SERVER_H_INCLUDED
@@ -0,0 +1,388 @@
+//--------------------------------------------------------------------------------------
+// RecordSearch.cpp
+// The per day record search, run fresh for each query or kept per station
+
+#include <iostream>
+
+#include "RecordSearch.h"
+#include "Kernels.h"
+#include "RunStats.h"
+
+RecordTotals::RecordTotals(size_t most_recent_year) :
+                            record_max_per_year(FIRST_YEAR, most_recent_year),
+                            record_min_per_year(FIRST_YEAR, most_recent_year),
+                            record_incremental_max_per_year(FIRST_YEAR, most_recent_year),
+                            record_incremental_min_per_year(FIRST_YEAR, most_recent_year),
+                            total_temperature_per_year(FIRST_YEAR, most_recent_year),
+                            number_of_readings_per_year(FIRST_YEAR, most_recent_year),
+                            total_max_temperature_per_year(FIRST_YEAR, most_recent_year),
+                            number_of_max_readings_per_year(FIRST_YEAR, most_recent_year),
+                            total_min_temperature_per_year(FIRST_YEAR, most_recent_year),
+                            number_of_min_readings_per_year(FIRST_YEAR, most_recent_year)
+{
+    for (size_t year = 0; year < NUMBER_OF_YEARS; year++)
+    {
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            number_of_readings_per_month[year][month] = 0;
+            number_of_max_readings_per_month[year][month] = 0;
+            number_of_min_readings_per_month[year][month] = 0;
+        }
+    }
+}
+
+void
+RecordTotals::add(RecordTotals& other)
+{
+    record_max_per_year.add(other.record_max_per_year);
+    record_min_per_year.add(other.record_min_per_year);
+    record_incremental_max_per_year.add(other.record_incremental_max_per_year);
+    record_incremental_min_per_year.add(other.record_incremental_min_per_year);
+    total_temperature_per_year.add(other.total_temperature_per_year);
+    number_of_readings_per_year.add(other.number_of_readings_per_year);
+    total_max_temperature_per_year.add(other.total_max_temperature_per_year);
+    number_of_max_readings_per_year.add(other.number_of_max_readings_per_year);
+    total_min_temperature_per_year.add(other.total_min_temperature_per_year);
+    number_of_min_readings_per_year.add(other.number_of_min_readings_per_year);
+
+    for (size_t year = 0; year < NUMBER_OF_YEARS; year++)
+    {
+        for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+        {
+            total_temperature_per_month[year][month] += other.total_temperature_per_month[year][month];
+            number_of_readings_per_month[year][month] += other.number_of_readings_per_month[year][month];
+            total_max_temperature_per_month[year][month] += other.total_max_temperature_per_month[year][month];
+            number_of_max_readings_per_month[year][month] += other.number_of_max_readings_per_month[year][month];
+            total_min_temperature_per_month[year][month] += other.total_min_temperature_per_month[year][month];
+            number_of_min_readings_per_month[year][month] += other.number_of_min_readings_per_month[year][month];
+        }
+    }
+}
+
+void
+RecordTotals::addMonth(unsigned int year, size_t month, float max_sum, float min_sum, unsigned int max_count, unsigned int min_count)
+{
+    total_temperature_per_year[year] += max_sum;
+    total_temperature_per_year[year] += min_sum;
+    total_temperature_per_month[year - FIRST_YEAR][month] += max_sum;
+    total_temperature_per_month[year - FIRST_YEAR][month] += min_sum;
+    total_max_temperature_per_month[year - FIRST_YEAR][month] += max_sum;
+    total_max_temperature_per_year[year] += max_sum;
+    total_min_temperature_per_month[year - FIRST_YEAR][month] += min_sum;
+    total_min_temperature_per_year[year] += min_sum;
+
+    number_of_readings_per_year[year] += max_count + min_count;
+    number_of_readings_per_month[year - FIRST_YEAR][month] += max_count + min_count;
+    number_of_max_readings_per_month[year - FIRST_YEAR][month] += max_count;
+    number_of_max_readings_per_year[year] += max_count;
+    number_of_min_readings_per_month[year - FIRST_YEAR][month] += min_count;
+    number_of_min_readings_per_year[year] += min_count;
+}
+
+// Print the station's readings on the date being dumped, in the year at
+// year_index
+static void
+dumpDailyReadings(Station& station, size_t year_index, const RecordQuery& query, ReportWriter& dump_stream)
+{
+    DailyColumns& daily_columns = station.getDailyColumns();
+    size_t slot = DailyColumns::getSlot(year_index, query.month_to_dump - 1, query.day_to_dump - 1);
+    float max_temperature = daily_columns.getMaxTemperature(slot);
+    float min_temperature = daily_columns.getMinTemperature(slot);
+
+    if ( (max_temperature != UNKNOWN_TEMPERATURE) && ( min_temperature != UNKNOWN_TEMPERATURE) )
+    {
+        dump_stream.setWidth(15) << station.getStateName() << ",  ";
+        dump_stream << station.getStationName() << ", " << query.month_to_dump << "/" << query.day_to_dump;
+        dump_stream << "/" << station.getYearVector()[year_index].getYear();
+        dump_stream << ", ";
+        dump_stream.setWidth(3) << max_temperature << ", ";
+        dump_stream.setWidth(3) << min_temperature << std::endl;
+    }
+}
+
+// Count the years holding the station's records into totals, and print the
+// record high of the date being dumped, if the station covers every year
+// the records are compared over
+static void
+addRecordYears(Station& station, const RecordTable& record_table, const RecordQuery& query, RecordTotals& totals, ReportWriter& dump_stream)
+{
+    std::vector<Year>& year_vector = station.getYearVector();
+
+    if (   year_vector.empty()
+        || year_vector.front().getYear() > query.start_year_for_comparing_records
+        || year_vector.back().getYear() < query.most_recent_year )
+    {
+        return;
+    }
+
+    if (   query.month_to_dump && query.month_to_dump <= NUMBER_OF_MONTHS_PER_YEAR
+        && query.day_to_dump && query.day_to_dump <= MAX_DAYS_IN_MONTH && query.year_to_dump == 0 )
+    {
+        size_t day = RecordTable::getDay(query.month_to_dump - 1, query.day_to_dump - 1);
+        size_t number_of_years = record_table.getNumberOfYears(RecordTable::RECORD_HIGH, day);
+        const uint16_t* years = record_table.getYears(RecordTable::RECORD_HIGH, day);
+
+        // Days no year ever had a reading for have nothing to print
+        if (number_of_years)
+        {
+            dump_stream.setWidth(15) << station.getStateName() << ",  ";
+            dump_stream << station.getStationName() << ", " << query.month_to_dump << "/" << query.day_to_dump;
+            dump_stream << ", ";
+            dump_stream.setWidth(3) << record_table.getRecordTemperature(RecordTable::RECORD_HIGH, day) << ", ";
+
+            for (size_t k = 0; k + 1 < number_of_years; k++)
+            {
+                dump_stream << (unsigned int)years[k] << ", ";
+            }
+
+            dump_stream << (unsigned int)years[number_of_years - 1] << std::endl;
+        }
+    }
+
+    for (size_t day = 0; day < RecordTable::NUMBER_OF_DAYS; day++)
+    {
+        size_t number_of_max_years = record_table.getNumberOfYears(RecordTable::RECORD_HIGH, day);
+        const uint16_t* max_years = record_table.getYears(RecordTable::RECORD_HIGH, day);
+        size_t number_of_min_years = record_table.getNumberOfYears(RecordTable::RECORD_LOW, day);
+        const uint16_t* min_years = record_table.getYears(RecordTable::RECORD_LOW, day);
+
+        for (size_t k = 0; k < number_of_max_years; k++)
+        {
+            totals.record_max_per_year[ max_years[k] ]++;
+        }
+
+        for (size_t k = 0; k < number_of_min_years; k++)
+        {
+            totals.record_min_per_year[ min_years[k] ]++;
+        }
+    }
+}
+
+void
+countStationRecords(Station& station, const RecordQuery& query, RecordTotals& totals, ReportWriter& dump_stream)
+{
+    std::vector<Year>& year_vector = station.getYearVector();
+    size_t year_vector_size = year_vector.size();
+    DailyColumns& daily_columns = station.getDailyColumns();
+
+    if ( query.start_year_for_comparing_records && !query.month_under_test && !query.station_under_test && !query.month_to_dump &&
+         (   !year_vector_size 
+           || year_vector.at(0).getYear() > query.start_year_for_comparing_records 
+           || year_vector.at(year_vector_size - 1).getYear() < query.most_recent_year 
+         )
+       )
+    {
+        return;
+    }
+
+    size_t station_number = station.getStationNumber();
+
+    if ( query.station_under_test && (query.station_under_test != station_number) )
+    {
+        return;
+    }
+
+    // The records as of the years and months this query looks at, which
+    // the saved tables can't give
+    RecordTable record_table;
+
+    for (size_t year_number = 0; year_number < year_vector_size; year_number++)
+    {
+        unsigned int year = year_vector.at(year_number).getYear();
+
+        if ( query.year_under_test && (query.year_under_test != year) )
+        {
+            continue;
+        }
+
+        for (size_t month_number = 0; month_number < NUMBER_OF_MONTHS_PER_YEAR; month_number++)
+        {
+            if ( query.month_under_test && !query.months_under_test[month_number + 1] )
+            {
+                continue;
+            }
+
+            if ( (query.year_to_dump == year) && ( query.month_to_dump == (month_number + 1) ) && query.day_to_dump &&
+                 query.day_to_dump <= MAX_DAYS_IN_MONTH )
+            {
+                dumpDailyReadings(station, year_number, query, dump_stream);
+            }
+
+            // Sum, count and compare the whole month, a contiguous run of 31
+            // slots in the station's columns, against the records at once.
+            // The kernels skip broken readings.
+            BlockScan max_scan;
+            BlockScan min_scan;
+            scanMonthBlocks(daily_columns, year_number, month_number, record_table.getMonthRecords(RecordTable::RECORD_HIGH, month_number),
+                            record_table.getMonthRecords(RecordTable::RECORD_LOW, month_number), max_scan, min_scan);
+
+            totals.addMonth( year, month_number, max_scan.sum, min_scan.sum, max_scan.count, min_scan.count );
+            totals.record_incremental_max_per_year[year] += countBits(max_scan.greater_mask);
+            totals.record_incremental_min_per_year[year] += countBits(min_scan.greater_mask);
+
+            // Only the days that tied or set a record need their years touched
+            record_table.addYear(RecordTable::RECORD_HIGH, month_number, year, max_scan.greater_mask, max_scan.equal_mask);
+            record_table.addYear(RecordTable::RECORD_LOW, month_number, year, min_scan.greater_mask, min_scan.equal_mask);
+        }
+    }
+
+    record_table.pack();
+    addRecordYears(station, record_table, query, totals, dump_stream);
+}
+
+void
+countRecordsForStations(std::vector<Station*>* station_pointer_vector, size_t first, size_t last,
+                        const RecordQuery* query, RecordTotals* totals, std::vector<std::string>* dump_vector)
+{
+    for (size_t i = first; i < last; i++)
+    {
+        ReportWriter dump_stream( (*dump_vector)[i] );
+        countStationRecords(*(*station_pointer_vector)[i], *query, *totals, dump_stream);
+    }
+}
+
+void
+StationRecordState::scan(Station& station, size_t first_slot)
+{
+    std::vector<Year>& year_vector = station.getYearVector();
+    DailyColumns& daily_columns = station.getDailyColumns();
+    size_t number_of_slots = year_vector.size() * NUMBER_OF_MONTHS_PER_YEAR;
+
+    if (first_slot == 0)
+    {
+        *this = StationRecordState();
+    }
+
+    // Months past the last one with data were empty when they were last
+    // scanned, so they added nothing that needs taking back out
+    year_totals_vector.resize( year_vector.size() );
+
+    for (size_t slot = first_slot; slot < number_of_slots; slot++)
+    {
+        size_t year_index = slot / NUMBER_OF_MONTHS_PER_YEAR;
+        size_t month_number = slot % NUMBER_OF_MONTHS_PER_YEAR;
+        unsigned int year = year_vector[year_index].getYear();
+        StationYearTotals& year_totals = year_totals_vector[year_index];
+
+        BlockScan max_scan;
+        BlockScan min_scan;
+        scanMonthBlocks(daily_columns, year_index, month_number, record_table.getMonthRecords(RecordTable::RECORD_HIGH, month_number),
+                        record_table.getMonthRecords(RecordTable::RECORD_LOW, month_number), max_scan, min_scan);
+
+        year_totals.max_sums[month_number] = max_scan.sum;
+        year_totals.min_sums[month_number] = min_scan.sum;
+        year_totals.max_counts[month_number] = max_scan.count;
+        year_totals.min_counts[month_number] = min_scan.count;
+        year_totals.incremental_max_records += countBits(max_scan.greater_mask);
+        year_totals.incremental_min_records += countBits(min_scan.greater_mask);
+
+        record_table.addYear(RecordTable::RECORD_HIGH, month_number, year, max_scan.greater_mask, max_scan.equal_mask);
+        record_table.addYear(RecordTable::RECORD_LOW, month_number, year, min_scan.greater_mask, min_scan.equal_mask);
+
+        if (max_scan.count || min_scan.count)
+        {
+            scanned_slots = slot + 1;
+        }
+    }
+
+    record_table.pack();
+}
+
+void
+StationRecordState::update(Station& station, size_t changed_slot)
+{
+    scan( station, (changed_slot >= scanned_slots) ? scanned_slots : 0 );
+}
+
+void
+StationRecordState::addTo(Station& station, const RecordQuery& query, RecordTotals& totals, ReportWriter& dump_stream) const
+{
+    std::vector<Year>& year_vector = station.getYearVector();
+    size_t year_vector_size = year_vector.size();
+
+    // The same stations as countStationRecords() leaves out
+    if (   !year_vector_size
+        || (    query.start_year_for_comparing_records && !query.station_under_test && !query.month_to_dump
+             && (   year_vector.at(0).getYear() > query.start_year_for_comparing_records
+                 || year_vector.at(year_vector_size - 1).getYear() < query.most_recent_year ) )
+        || ( query.station_under_test && query.station_under_test != station.getStationNumber() ) )
+    {
+        return;
+    }
+
+    // Same additions as the scan. The sums are exact, so they come out bit
+    // for bit the same whatever order the stations are added in.
+    for (size_t year_index = 0; year_index < year_vector_size; year_index++)
+    {
+        unsigned int year = year_vector[year_index].getYear();
+        const StationYearTotals& year_totals = year_totals_vector[year_index];
+
+        if (   query.year_to_dump == year && query.month_to_dump && query.month_to_dump <= NUMBER_OF_MONTHS_PER_YEAR
+            && query.day_to_dump && query.day_to_dump <= MAX_DAYS_IN_MONTH )
+        {
+            dumpDailyReadings(station, year_index, query, dump_stream);
+        }
+
+        for (size_t month_number = 0; month_number < NUMBER_OF_MONTHS_PER_YEAR; month_number++)
+        {
+            totals.addMonth( year, month_number, year_totals.max_sums[month_number], year_totals.min_sums[month_number],
+                             year_totals.max_counts[month_number], year_totals.min_counts[month_number] );
+        }
+
+        totals.record_incremental_max_per_year[year] += year_totals.incremental_max_records;
+        totals.record_incremental_min_per_year[year] += year_totals.incremental_min_records;
+    }
+
+    addRecordYears(station, record_table, query, totals, dump_stream);
+}
+
+bool
+canUseRecordStates(const RecordQuery& query)
+{
+    return !query.year_under_test && !query.month_under_test;
+}
+
+void
+buildRecordStates(Country& US, RecordStateMap& record_state_map)
+{
+    StageTimer timer(STAGE_RECORD_SEARCH);
+    std::vector<State>& state_vector = US.getStateVector();
+
+    for (size_t state_number = 0; state_number < state_vector.size(); state_number++)
+    {
+        std::vector<Station>& station_vector = state_vector[state_number].getStationVector();
+
+        for (size_t station_number = 0; station_number < station_vector.size(); station_number++)
+        {
+            Station& station = station_vector[station_number];
+            record_state_map[ station.getStationNumber() ].scan(station, 0);
+        }
+    }
+}
+
+void
+addStationRecords(Station& station, const RecordStateMap& record_state_map, const RecordQuery& query, RecordTotals& totals, ReportWriter& dump_stream)
+{
+    RecordStateMap::const_iterator state_it = record_state_map.find( station.getStationNumber() );
+
+    // A station without a state of its own is searched the slow way
+    if ( state_it == record_state_map.end() || state_it->second.year_totals_vector.size() != station.getYearVector().size() )
+    {
+        countStationRecords(station, query, totals, dump_stream);
+        return;
+    }
+
+    state_it->second.addTo(station, query, totals, dump_stream);
+}
+
+void
+addRecordStatesForStations(std::vector<Station*>* station_pointer_vector, size_t first, size_t last,
+                           const RecordStateMap* record_state_map, const RecordQuery* query, RecordTotals* totals,
+                           std::vector<std::string>* dump_vector)
+{
+    for (size_t i = first; i < last; i++)
+    {
+        ReportWriter dump_stream( (*dump_vector)[i] );
+        addStationRecords(*(*station_pointer_vector)[i], *record_state_map, *query, *totals, dump_stream);
+    }
+}
@@ -0,0 +1,134 @@
+//--------------------------------------------------------------------------------------
+// RecordSearch.h
+// The per day record search. For every station, month and day it finds the
+// years holding the record high and low, and it sums the readings behind
+// the yearly and monthly averages.
+
+#ifndef RECORD_SEARCH_H_INCLUDED
+#define RECORD_SEARCH_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <ostream>
+
+#include "USHCN.h"
+#include "RecordTable.h"
+#include "ReportWriter.h"
+
+// Options for the record counting pass, fixed once the arguments are parsed
+struct RecordQuery
+{
+    size_t                  station_under_test;
+    size_t                  year_under_test;
+    size_t                  month_under_test;
+    bool                    months_under_test[NUMBER_OF_MONTHS_PER_YEAR + 1];
+    size_t                  month_to_dump;
+    size_t                  day_to_dump;
+    size_t                  year_to_dump;
+    size_t                  start_year_for_comparing_records;
+    size_t                  most_recent_year;
+};
+
+// Record counts and sums from the record counting pass.
+// Every worker thread fills in its own, they are added up at the end. The
+// sums are ExactSums, so the totals don't depend on how the stations were
+// split between threads.
+struct RecordTotals
+{
+                            RecordTotals(size_t most_recent_year);
+    void                    add(RecordTotals& other);
+
+    // Add one station-month's sums and counts
+    void                    addMonth(unsigned int year, size_t month, float max_sum, float min_sum, unsigned int max_count, unsigned int min_count);
+
+    YearSeries<unsigned int> record_max_per_year;
+    YearSeries<unsigned int> record_min_per_year;
+    YearSeries<unsigned int> record_incremental_max_per_year;
+    YearSeries<unsigned int> record_incremental_min_per_year;
+    YearSeries<ExactSum> total_temperature_per_year;
+    YearSeries<unsigned int> number_of_readings_per_year;
+    YearSeries<ExactSum> total_max_temperature_per_year;
+    YearSeries<unsigned int> number_of_max_readings_per_year;
+    YearSeries<ExactSum> total_min_temperature_per_year;
+    YearSeries<unsigned int> number_of_min_readings_per_year;
+    ExactSum total_temperature_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+    unsigned int number_of_readings_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+    ExactSum total_max_temperature_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+    unsigned int number_of_max_readings_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+    ExactSum total_min_temperature_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+    unsigned int number_of_min_readings_per_month[NUMBER_OF_YEARS][NUMBER_OF_MONTHS_PER_YEAR];
+};
+
+// Per day record search for one station. Stations don't share anything,
+// so this runs on any thread as long as each has its own totals.
+void countStationRecords(Station& station, const RecordQuery& query, RecordTotals& totals, ReportWriter& dump_stream);
+
+// Worker for a contiguous run of stations. Dumped lines are buffered per
+// station so they can be printed in the serial order afterwards.
+void countRecordsForStations(std::vector<Station*>* station_pointer_vector, size_t first, size_t last,
+                             const RecordQuery* query, RecordTotals* totals, std::vector<std::string>* dump_vector);
+
+// One year of one station's sums from an unfiltered record search
+struct StationYearTotals
+{
+    float                   max_sums[NUMBER_OF_MONTHS_PER_YEAR];
+    float                   min_sums[NUMBER_OF_MONTHS_PER_YEAR];
+    unsigned int            max_counts[NUMBER_OF_MONTHS_PER_YEAR];
+    unsigned int            min_counts[NUMBER_OF_MONTHS_PER_YEAR];
+    unsigned int            incremental_max_records;
+    unsigned int            incremental_min_records;
+};
+
+// What the record search of one station leaves behind when no year or
+// month is filtered out: its RecordTable and the sums for every year. It is
+// built once, after the ingest or from the snapshot, and kept for every
+// query that follows, so months appended to a station later only need those
+// months scanned, and queries with at most a station or a date are answered
+// without a scan. The date's records and tied years are looked up in the
+// table directly.
+//
+// Months are numbered as slots, year index * 12 + month.
+struct StationRecordState
+{
+                            StationRecordState() : scanned_slots(0) {}
+
+    // Scan the station's months from first_slot on, carrying on from the
+    // records so far. A first_slot of 0 starts over.
+    void                    scan(Station& station, size_t first_slot);
+
+    // Bring the state up to date after the station's months from
+    // changed_slot on were written. Months after the last one with data
+    // can be scanned on their own, anything earlier means a rescan.
+    void                    update(Station& station, size_t changed_slot);
+
+    // Add the station to totals, and print its lines for date=, exactly as
+    // countStationRecords() would
+    void                    addTo(Station& station, const RecordQuery& query, RecordTotals& totals, ReportWriter& dump_stream) const;
+
+    size_t                  scanned_slots;  // one past the last month with data
+    RecordTable             record_table;
+    std::vector<StationYearTotals> year_totals_vector;
+};
+
+// Saved record search state for every station, by station number
+typedef std::unordered_map<unsigned int, StationRecordState> RecordStateMap;
+
+// Whether query can be answered from a RecordStateMap
+bool canUseRecordStates(const RecordQuery& query);
+
+// Scan every station in US into record_state_map
+void buildRecordStates(Country& US, RecordStateMap& record_state_map);
+
+// Add one station to totals from its saved state, or search it when it
+// has none
+void addStationRecords(Station& station, const RecordStateMap& record_state_map, const RecordQuery& query, RecordTotals& totals,
+                       ReportWriter& dump_stream);
+
+// Worker for a contiguous run of stations answered from their saved state.
+// Dumped lines are buffered per station, as in countRecordsForStations().
+void addRecordStatesForStations(std::vector<Station*>* station_pointer_vector, size_t first, size_t last,
+                                const RecordStateMap* record_state_map, const RecordQuery* query, RecordTotals* totals,
+                                std::vector<std::string>* dump_vector);
+
+#endif // RECORD_SEARCH_H_INCLUDED
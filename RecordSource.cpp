@@ -0,0 +1,211 @@
+//--------------------------------------------------------------------------------------
+// RecordSource.cpp
+// The built in USHCN decoders and the format registry
+
+#include <string.h>
+#include <string>
+
+#include "RecordSource.h"
+
+// Fixed width field helpers for lines handed out by MappedFile.
+// Fields running off the end of a short line are clipped, like substr().
+static long
+parseField(const char* line, size_t length, size_t position, size_t width)
+{
+    if (position >= length)
+    {
+        return 0;
+    }
+
+    return parseFixedWidthInteger( line + position, (position + width <= length) ? width : length - position );
+}
+
+static bool
+fieldEquals(const char* line, size_t length, size_t position, const char* text)
+{
+    size_t width = strlen(text);
+    return ( position + width <= length ) && ( memcmp(line + position, text, width) == 0 );
+}
+
+// Length of the first line in data, without its newline
+static size_t
+firstLineLength(const char* data, size_t size)
+{
+    const char* line_end = (const char*)memchr(data, '\n', size);
+    return (line_end == NULL) ? size : size_t(line_end - data);
+}
+
+// Daily archive, http://cdiac.ornl.gov/ftp/ushcn_daily/
+// COOP ID(6) YEAR(4) MONTH(2) ELEMENT(4) then 31 x VALUE(5) + 3 flags
+class UshcnDailySource : public RecordSource
+{
+public:
+    virtual const char*     getName() const { return "daily"; }
+    virtual bool            isDaily() const { return true; }
+
+    virtual int             probe(const char* data, size_t size) const
+                            {
+                                size_t length = firstLineLength(data, size);
+
+                                if (   fieldEquals(data, length, 0, "USH")
+                                    || ( !fieldEquals(data, length, 6, "18") && !fieldEquals(data, length, 6, "19") && !fieldEquals(data, length, 6, "20") ) )
+                                {
+                                    return 0;
+                                }
+
+                                // A full length record with a known element is a sure thing
+                                return (   length >= DataRecord::MINIMUM_RECORD_LENGTH
+                                        && DataRecord::parseRecordType(data + 12) != DataRecord::RECORD_TYPE_NONE ) ? 100 : 50;
+                            }
+
+    virtual bool            decodeDaily(const char* line, size_t length, DataRecord& record) const
+                            {
+                                return record.parseTemperatureRecord(line, length);
+                            }
+};
+
+// Monthly v2 archive: station(6) type(1) year(4) then 12 x value(5) at a
+// stride of 7, in tenths of a degree Fahrenheit
+class UshcnV2Source : public RecordSource
+{
+public:
+    virtual const char*     getName() const { return "v2"; }
+    virtual bool            isDaily() const { return false; }
+
+    // Anything that isn't one of the other formats has always been read
+    // as v2, so it takes the lowest score
+    virtual int             probe(const char* data, size_t size) const
+                            {
+                                return ( size > 0 && !fieldEquals(data, firstLineLength(data, size), 0, "USH") ) ? 1 : 0;
+                            }
+
+    virtual bool            decodeMonthly(const char* line, size_t length, MonthlyRecord& record) const
+                            {
+                                if (length == 0)
+                                {
+                                    return false;
+                                }
+
+                                record.setStationNumber( (unsigned int)parseField(line, length, 0, 6) );
+                                record.setStateNumber( (unsigned int)parseField(line, length, 0, 2) );
+                                record.setYear( (unsigned int)parseField(line, length, 7, 4) );
+                                size_t position = 12;
+
+                                for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+                                {
+                                    bool valid = !fieldEquals(line, length, position, "-9999");
+                                    float temperature = valid ? (float)( parseField(line, length, position, 5) ) / 10.0f : UNKNOWN_TEMPERATURE;
+                                    record.setTemperature(month, temperature, valid, false);
+                                    position += 7;
+                                }
+
+                                return true;
+                            }
+};
+
+// Monthly v2.5 archive: "USH" + station, year at 12, then 12 x value(6) in
+// hundredths of a degree Celsius followed by DM/QC/DS flags, at a stride of 9
+class UshcnV25Source : public RecordSource
+{
+public:
+    virtual const char*     getName() const { return "v2.5"; }
+    virtual bool            isDaily() const { return false; }
+    virtual bool            hasFabricationFlags() const { return true; }
+
+    virtual int             probe(const char* data, size_t size) const
+                            {
+                                return fieldEquals(data, firstLineLength(data, size), 0, "USH") ? 100 : 0;
+                            }
+
+    virtual bool            decodeMonthly(const char* line, size_t length, MonthlyRecord& record) const
+                            {
+                                if (length == 0)
+                                {
+                                    return false;
+                                }
+
+                                record.setStationNumber( (unsigned int)parseField(line, length, 5, 6) );
+                                record.setStateNumber( (unsigned int)parseField(line, length, 5, 2) );
+                                record.setYear( (unsigned int)parseField(line, length, 12, 4) );
+                                size_t position = 16;
+
+                                for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+                                {
+                                    if ( fieldEquals(line, length, position, " -9999") )
+                                    {
+                                        record.setTemperature(month, UNKNOWN_TEMPERATURE, false, false);
+                                    }
+                                    else
+                                    {
+                                        float temperature = (float)( parseField(line, length, position, 6) ) / 100.0f;
+                                        temperature = (temperature * 1.8f) + 32;
+                                        record.setTemperature( month, temperature, true, fieldEquals(line, length, position + 6, "E") );
+                                    }
+
+                                    position += 9;
+                                }
+
+                                return true;
+                            }
+};
+
+std::vector<const RecordSource*>&
+getRecordSources()
+{
+    static UshcnDailySource daily_source;
+    static UshcnV2Source v2_source;
+    static UshcnV25Source v25_source;
+    static const RecordSource* built_in_sources[] = { &daily_source, &v2_source, &v25_source };
+    static std::vector<const RecordSource*> source_vector( built_in_sources, built_in_sources + 3 );
+
+    return source_vector;
+}
+
+void
+registerRecordSource(const RecordSource* source)
+{
+    getRecordSources().push_back(source);
+}
+
+const RecordSource*
+detectRecordSource(const char* data, size_t size)
+{
+    std::vector<const RecordSource*>& source_vector = getRecordSources();
+    const RecordSource* best_source = NULL;
+    int best_score = 0;
+
+    if (size > RECORD_SOURCE_PROBE_SIZE)
+    {
+        size = RECORD_SOURCE_PROBE_SIZE;
+    }
+
+    // Ties go to whichever was registered first
+    for (size_t i = 0; i < source_vector.size(); i++)
+    {
+        int score = source_vector[i]->probe(data, size);
+
+        if (score > best_score)
+        {
+            best_score = score;
+            best_source = source_vector[i];
+        }
+    }
+
+    return best_source;
+}
+
+const RecordSource*
+findRecordSource(const std::string& name)
+{
+    std::vector<const RecordSource*>& source_vector = getRecordSources();
+
+    for (size_t i = 0; i < source_vector.size(); i++)
+    {
+        if ( name == source_vector[i]->getName() )
+        {
+            return source_vector[i];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,100 @@
+//--------------------------------------------------------------------------------------
+// RecordSource.h
+// Decoders for the USHCN archive formats. Every format registers a probe
+// that looks at the start of a file, and detectRecordSource() hands back
+// the decoder that is most confident it can read it. Adding a format is a
+// matter of writing one RecordSource and registering it.
+
+#ifndef RECORD_SOURCE_H_INCLUDED
+#define RECORD_SOURCE_H_INCLUDED
+
+#include <vector>
+#include <stddef.h>
+
+#include "USHCN.h"
+
+// Probes never look further into a file than this
+static const size_t         RECORD_SOURCE_PROBE_SIZE = 4096;
+
+// One station-year from a monthly archive, temperatures in Fahrenheit
+class MonthlyRecord
+{
+public:
+                            MonthlyRecord()
+                            {
+                                setStationNumber(0);
+                                setStateNumber(0);
+                                setYear(0);
+
+                                for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+                                {
+                                    setTemperature(month, UNKNOWN_TEMPERATURE, false, false);
+                                }
+                            }
+
+    unsigned int            getStationNumber() { return m_station_number; }
+    void                    setStationNumber(unsigned int value) { m_station_number = value; }
+    unsigned int            getStateNumber() { return m_state_number; }
+    void                    setStateNumber(unsigned int value) { m_state_number = value; }
+    unsigned int            getYear() { return m_year; }
+    void                    setYear(unsigned int value) { m_year = value; }
+    float                   getTemperature(size_t month) { return m_temperatures[month]; }
+    bool                    isValid(size_t month) { return m_valid[month]; }
+    bool                    isFabricated(size_t month) { return m_fabricated[month]; }
+
+    void                    setTemperature(size_t month, float value, bool valid, bool fabricated)
+                            {
+                                m_temperatures[month] = value;
+                                m_valid[month] = valid;
+                                m_fabricated[month] = fabricated;
+                            }
+
+protected:
+    unsigned int            m_station_number;
+    unsigned int            m_state_number;
+    unsigned int            m_year;
+    float                   m_temperatures[NUMBER_OF_MONTHS_PER_YEAR];
+    bool                    m_valid[NUMBER_OF_MONTHS_PER_YEAR];
+    bool                    m_fabricated[NUMBER_OF_MONTHS_PER_YEAR];
+};
+
+// A decoder for one archive format. Decoders hold no per file state, so one
+// instance can be shared by every ingest thread.
+class RecordSource
+{
+public:
+    virtual                 ~RecordSource() {}
+
+    // Short name, as given to format=
+    virtual const char*     getName() const = 0;
+
+    // How sure this decoder is that data (the first size bytes of a file)
+    // is in its format. 0 means it isn't, the highest score wins.
+    virtual int             probe(const char* data, size_t size) const = 0;
+
+    // Daily sources decode into DataRecords, monthly ones into MonthlyRecords
+    virtual bool            isDaily() const = 0;
+
+    // Monthly sources that flag estimated values with an 'E'
+    virtual bool            hasFabricationFlags() const { return false; }
+
+    // Decode one line without its newline. Returns false for lines that
+    // don't hold a record.
+    virtual bool            decodeDaily(const char* /*line*/, size_t /*length*/, DataRecord& /*record*/) const { return false; }
+    virtual bool            decodeMonthly(const char* /*line*/, size_t /*length*/, MonthlyRecord& /*record*/) const { return false; }
+};
+
+// The registered decoders, built in ones first
+std::vector<const RecordSource*>& getRecordSources();
+
+// Make source available to detectRecordSource() and findRecordSource().
+// The caller keeps ownership.
+void registerRecordSource(const RecordSource* source);
+
+// The best scoring decoder for a file starting with data, NULL if none match
+const RecordSource* detectRecordSource(const char* data, size_t size);
+
+// The decoder called name, NULL if there isn't one
+const RecordSource* findRecordSource(const std::string& name);
+
+#endif // RECORD_SOURCE_H_INCLUDED
@@ -0,0 +1,140 @@
+//--------------------------------------------------------------------------------------
+// RecordTable.cpp
+// Per station, per day records in a flat layout, see RecordTable.h
+
+#include <string.h>
+
+#include "RecordTable.h"
+#include "Kernels.h"
+
+const size_t RecordTable::NUMBER_OF_DAYS;
+const size_t RecordTable::NUMBER_OF_CELLS;
+const uint32_t RecordTable::NO_ENTRY;
+
+void
+RecordTable::clear()
+{
+    for (size_t day = 0; day < NUMBER_OF_DAYS; day++)
+    {
+        m_record_temperatures[ getCell(RECORD_HIGH, day) ] = float(INT_MIN);
+        m_record_temperatures[ getCell(RECORD_LOW, day) ] = float(INT_MAX);
+    }
+
+    memset( m_year_start, 0, sizeof(m_year_start) );
+    m_year_vector.clear();
+    m_log_vector.clear();
+    m_last_entry_vector.clear();
+}
+
+uint32_t
+RecordTable::log(uint32_t previous, unsigned int year)
+{
+    LogEntry entry;
+    entry.previous = previous;
+    entry.year = uint16_t(year);
+    m_log_vector.push_back(entry);
+    return uint32_t( m_log_vector.size() - 1 );
+}
+
+void
+RecordTable::addYear(Record record, size_t month, unsigned int year, uint32_t greater_mask, uint32_t equal_mask)
+{
+    if ( m_last_entry_vector.empty() )
+    {
+        m_last_entry_vector.assign(NUMBER_OF_CELLS, NO_ENTRY);
+    }
+
+    for (uint32_t mask = greater_mask | equal_mask; mask; mask &= mask - 1)
+    {
+        size_t day_number = lowestBit(mask);
+        size_t cell = getCell( record, getDay(month, day_number) );
+        uint32_t& last_entry = m_last_entry_vector[cell];
+
+        if ( greater_mask & (1u << day_number) )
+        {
+            last_entry = log(NO_ENTRY, year);
+            continue;
+        }
+
+        // A tie on a record from before the last pack() carries on from its
+        // packed years
+        if (last_entry == NO_ENTRY)
+        {
+            for (uint32_t k = m_year_start[cell]; k < m_year_start[cell + 1]; k++)
+            {
+                last_entry = log(last_entry, m_year_vector[k]);
+            }
+        }
+
+        last_entry = log(last_entry, year);
+    }
+}
+
+void
+RecordTable::pack()
+{
+    if ( m_last_entry_vector.empty() )
+    {
+        return;
+    }
+
+    std::vector<uint16_t> year_vector;
+    year_vector.reserve( m_year_vector.size() + m_log_vector.size() );
+
+    for (size_t cell = 0; cell < NUMBER_OF_CELLS; cell++)
+    {
+        uint32_t first_year = m_year_start[cell];
+        uint32_t last_year = m_year_start[cell + 1];
+        uint32_t last_entry = m_last_entry_vector[cell];
+        m_year_start[cell] = uint32_t( year_vector.size() );
+
+        if (last_entry == NO_ENTRY)
+        {
+            year_vector.insert( year_vector.end(), m_year_vector.begin() + first_year, m_year_vector.begin() + last_year );
+            continue;
+        }
+
+        // Chains run newest first, so they are written from the back
+        size_t number_of_years = 0;
+
+        for (uint32_t entry = last_entry; entry != NO_ENTRY; entry = m_log_vector[entry].previous)
+        {
+            number_of_years++;
+        }
+
+        year_vector.resize(year_vector.size() + number_of_years);
+        size_t position = year_vector.size();
+
+        for (uint32_t entry = last_entry; entry != NO_ENTRY; entry = m_log_vector[entry].previous)
+        {
+            year_vector[--position] = m_log_vector[entry].year;
+        }
+    }
+
+    m_year_start[NUMBER_OF_CELLS] = uint32_t( year_vector.size() );
+    year_vector.shrink_to_fit();
+    m_year_vector.swap(year_vector);
+
+    // Release the log, a table spends most of its life packed
+    std::vector<LogEntry>().swap(m_log_vector);
+    std::vector<uint32_t>().swap(m_last_entry_vector);
+}
+
+bool
+RecordTable::isConsistent() const
+{
+    if (m_year_start[0] != 0 || m_year_start[NUMBER_OF_CELLS] != m_year_vector.size())
+    {
+        return false;
+    }
+
+    for (size_t cell = 0; cell < NUMBER_OF_CELLS; cell++)
+    {
+        if (m_year_start[cell] > m_year_start[cell + 1])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
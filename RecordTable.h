@@ -0,0 +1,102 @@
+//--------------------------------------------------------------------------------------
+// RecordTable.h
+// One station's record high and low for every calendar day, and the years
+// that set or tied them.
+//
+// Days are numbered month * 31 + day, and every day has a cell for its high
+// and one for its low, highs first. The record temperatures are a flat array
+// of cells. The years of all the cells sit back to back in one year array,
+// cell by cell, with an offset table of cells + 1 entries in front of it, so
+// a day's record and years are found by indexing, without a vector per cell.
+//
+// A scan adds years as the records move. Until pack() is called they go to
+// a log that chains each cell's years together, and pack() folds the log into
+// the flat layout. A packed table can be scanned on from where it left off.
+
+#ifndef RECORD_TABLE_H_INCLUDED
+#define RECORD_TABLE_H_INCLUDED
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "USHCN.h"
+
+class RecordTable
+{
+public:
+    static const size_t     NUMBER_OF_DAYS = NUMBER_OF_MONTHS_PER_YEAR * MAX_DAYS_IN_MONTH;
+    static const size_t     NUMBER_OF_CELLS = 2 * NUMBER_OF_DAYS;
+
+    enum Record
+    {
+        RECORD_HIGH = 0,
+        RECORD_LOW = 1
+    };
+
+                            RecordTable() { clear(); }
+
+    // No records, highs at INT_MIN and lows at INT_MAX, and no years
+    void                    clear();
+
+    static size_t           getDay(size_t month, size_t day) { return month * MAX_DAYS_IN_MONTH + day; }
+    static size_t           getCell(Record record, size_t day) { return record * NUMBER_OF_DAYS + day; }
+
+    // The month's 31 records, for the block kernels to compare against and raise
+    float*                  getMonthRecords(Record record, size_t month) { return &m_record_temperatures[ getCell( record, getDay(month, 0) ) ]; }
+
+    float                   getRecordTemperature(Record record, size_t day) const { return m_record_temperatures[ getCell(record, day) ]; }
+
+    // The years holding a record as of the last pack(), in the order they
+    // set or tied it
+    size_t                  getNumberOfYears(Record record, size_t day) const
+                            {
+                                size_t cell = getCell(record, day);
+                                return m_year_start[cell + 1] - m_year_start[cell];
+                            }
+
+    const uint16_t*         getYears(Record record, size_t day) const { return m_year_vector.data() + m_year_start[ getCell(record, day) ]; }
+
+    // A month of year was scanned: the days in greater_mask set a new
+    // record, the days in equal_mask tied it
+    void                    addYear(Record record, size_t month, unsigned int year, uint32_t greater_mask, uint32_t equal_mask);
+
+    // Fold the years added since the last pack() into the flat layout
+    void                    pack();
+
+    // The packed arrays, for the snapshot
+    float*                  getRecordTemperatureData() { return m_record_temperatures; }
+    const float*            getRecordTemperatureData() const { return m_record_temperatures; }
+    uint32_t*               getYearStartData() { return m_year_start; }
+    const uint32_t*         getYearStartData() const { return m_year_start; }
+    std::vector<uint16_t>&  getYearVector() { return m_year_vector; }
+    const std::vector<uint16_t>& getYearVector() const { return m_year_vector; }
+
+    // Whether the offsets run in order through the whole year array, for
+    // tables read back from a file
+    bool                    isConsistent() const;
+
+private:
+    static const uint32_t   NO_ENTRY = UINT32_MAX;
+
+    // One year in a cell's chain, previous is NO_ENTRY where the chain
+    // starts over with a new record
+    struct LogEntry
+    {
+        uint32_t            previous;
+        uint16_t            year;
+    };
+
+    uint32_t                log(uint32_t previous, unsigned int year);
+
+    float                   m_record_temperatures[NUMBER_OF_CELLS];
+    uint32_t                m_year_start[NUMBER_OF_CELLS + 1];
+    std::vector<uint16_t>   m_year_vector;
+
+    // Only while years are being added: each cell's newest log entry, or
+    // NO_ENTRY while its packed years are still current
+    std::vector<LogEntry>   m_log_vector;
+    std::vector<uint32_t>   m_last_entry_vector;
+};
+
+#endif // RECORD_TABLE_H_INCLUDED
@@ -0,0 +1,152 @@
+//--------------------------------------------------------------------------------------
+// ReportWriter.cpp
+// Buffered report output, see ReportWriter.h
+
+#include <charconv>
+#include <algorithm>
+#include <string.h>
+
+#include "ReportWriter.h"
+
+// Longest text any number converts to: 20 digits and a sign for the
+// integers, sign, 6 digits, point and a 4 character exponent for %g
+static const size_t         MAX_NUMBER_LENGTH = 32;
+
+bool
+ReportWriter::open(const std::string& file_name)
+{
+    close();
+
+    m_file = fopen(file_name.c_str(), "wb");
+    m_string = NULL;
+    m_owns_file = (m_file != NULL);
+    m_failed = false;
+    return m_file != NULL;
+}
+
+bool
+ReportWriter::close()
+{
+    flush();
+
+    if (m_file != NULL)
+    {
+        m_failed = ( m_owns_file ? fclose(m_file) : fflush(m_file) ) != 0 || m_failed;
+    }
+
+    m_file = NULL;
+    m_string = NULL;
+    m_owns_file = false;
+    return !m_failed;
+}
+
+void
+ReportWriter::flush()
+{
+    if ( m_file != NULL && !m_buffer.empty() )
+    {
+        m_failed = ( fwrite(&m_buffer[0], 1, m_buffer.size(), m_file) != m_buffer.size() ) || m_failed;
+    }
+
+    m_buffer.clear();
+}
+
+void
+ReportWriter::write(const char* text, size_t length)
+{
+    if (m_string != NULL)
+    {
+        m_string->append(text, length);
+        return;
+    }
+
+    if (m_file == NULL)
+    {
+        return;
+    }
+
+    if ( m_buffer.size() + length > BUFFER_SIZE )
+    {
+        flush();
+    }
+
+    if (length >= BUFFER_SIZE)
+    {
+        m_failed = ( fwrite(text, 1, length, m_file) != length ) || m_failed;
+        return;
+    }
+
+    if ( m_buffer.capacity() < BUFFER_SIZE )
+    {
+        m_buffer.reserve(BUFFER_SIZE);
+    }
+
+    m_buffer.insert(m_buffer.end(), text, text + length);
+}
+
+void
+ReportWriter::writeField(const char* text, size_t length)
+{
+    static const char padding[] = "                                ";
+
+    while (m_width > length)
+    {
+        size_t pad = std::min( m_width - length, sizeof(padding) - 1 );
+        write(padding, pad);
+        m_width -= pad;
+    }
+
+    m_width = 0;
+    write(text, length);
+}
+
+ReportWriter&
+ReportWriter::operator<<(const char* text)
+{
+    writeField( text, strlen(text) );
+    return *this;
+}
+
+void
+ReportWriter::writeSigned(long long value)
+{
+    char text[MAX_NUMBER_LENGTH];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    writeField(text, result.ptr - text);
+}
+
+void
+ReportWriter::writeUnsigned(unsigned long long value)
+{
+    char text[MAX_NUMBER_LENGTH];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    writeField(text, result.ptr - text);
+}
+
+ReportWriter&
+ReportWriter::operator<<(float value)
+{
+    // An ostream widens floats to double before formatting, which doesn't
+    // change the digits
+    return *this << double(value);
+}
+
+ReportWriter&
+ReportWriter::operator<<(double value)
+{
+    char text[MAX_NUMBER_LENGTH];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value, std::chars_format::general, 6);
+    writeField(text, result.ptr - text);
+    return *this;
+}
+
+ReportWriter&
+ReportWriter::operator<<(std::ostream& (*manipulator)(std::ostream&))
+{
+    if ( manipulator == static_cast<std::ostream& (*)(std::ostream&)>(std::endl) )
+    {
+        write("\n", 1);
+    }
+
+    return *this;
+}
@@ -0,0 +1,83 @@
+//--------------------------------------------------------------------------------------
+// ReportWriter.h
+// Buffered text output for the reports. Reports are hundreds of thousands of
+// short lines when dumps or long rankings are on, so instead of an ostream
+// that flushes on every std::endl, lines collect in a large buffer that is
+// written out when it fills or when the writer goes away. Numbers are
+// converted with std::to_chars, floats in the same %g form, to 6 significant
+// digits, that an ostream prints by default, so the output is byte for byte
+// what it always was.
+
+#ifndef REPORT_WRITER_H_INCLUDED
+#define REPORT_WRITER_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdio.h>
+#include <stddef.h>
+
+class ReportWriter
+{
+public:
+    static const size_t     BUFFER_SIZE = 1 << 20;
+
+    // Writes to file, which is left open
+                            ReportWriter(FILE* file) : m_file(file), m_string(NULL), m_owns_file(false), m_failed(false), m_width(0) {}
+
+    // Appends to string
+                            ReportWriter(std::string& string) : m_file(NULL), m_string(&string), m_owns_file(false), m_failed(false), m_width(0) {}
+
+    // Writes nowhere until open() is called
+                            ReportWriter() : m_file(NULL), m_string(NULL), m_owns_file(false), m_failed(false), m_width(0) {}
+
+                            ~ReportWriter() { close(); }
+                            ReportWriter(const ReportWriter&) = delete;
+    ReportWriter&           operator=(const ReportWriter&) = delete;
+
+    // Write to a new file_name from now on, false if it can't be created
+    bool                    open(const std::string& file_name);
+
+    // Flush, and close the file if open() opened it. Returns false if any
+    // write failed.
+    bool                    close();
+
+    // Hand the buffered text to the file. Strings are appended to directly.
+    void                    flush();
+
+    // Pad the next value on the left to width characters, like std::setw
+    ReportWriter&           setWidth(size_t width) { m_width = width; return *this; }
+
+    void                    write(const char* text, size_t length);
+
+    ReportWriter&           operator<<(const char* text);
+    ReportWriter&           operator<<(const std::string& text) { writeField( text.data(), text.size() ); return *this; }
+    ReportWriter&           operator<<(char character) { writeField(&character, 1); return *this; }
+    ReportWriter&           operator<<(int value) { writeSigned(value); return *this; }
+    ReportWriter&           operator<<(unsigned int value) { writeUnsigned(value); return *this; }
+    ReportWriter&           operator<<(long value) { writeSigned(value); return *this; }
+    ReportWriter&           operator<<(unsigned long value) { writeUnsigned(value); return *this; }
+    ReportWriter&           operator<<(long long value) { writeSigned(value); return *this; }
+    ReportWriter&           operator<<(unsigned long long value) { writeUnsigned(value); return *this; }
+    ReportWriter&           operator<<(float value);
+    ReportWriter&           operator<<(double value);
+
+    // std::endl ends the line, but doesn't flush. No other manipulator is
+    // supported.
+    ReportWriter&           operator<<(std::ostream& (*manipulator)(std::ostream&));
+
+private:
+    // Write one formatted value, honouring setWidth()
+    void                    writeField(const char* text, size_t length);
+    void                    writeSigned(long long value);
+    void                    writeUnsigned(unsigned long long value);
+
+    FILE*                   m_file;
+    std::string*            m_string;
+    bool                    m_owns_file;
+    bool                    m_failed;
+    size_t                  m_width;
+    std::vector<char>       m_buffer;
+};
+
+#endif // REPORT_WRITER_H_INCLUDED
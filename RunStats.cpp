@@ -0,0 +1,145 @@
+//--------------------------------------------------------------------------------------
+// RunStats.cpp
+// Process wide timers and counters, see RunStats.h
+
+#include <iostream>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "RunStats.h"
+
+static const char* const    STAGE_NAMES[NUMBER_OF_RUN_STAGES] =
+{
+    "ingest",
+    "merge",
+    "snapshot_read",
+    "snapshot_write",
+    "delta",
+    "monthly_parse",
+    "record_search",
+    "ranking",
+    "output"
+};
+
+static const char* const    COUNTER_NAMES[NUMBER_OF_RUN_COUNTERS] =
+{
+    "input_bytes",
+    "lines",
+    "records",
+    "short_lines",
+    "rejected_lines",
+    "stations_searched",
+    "queries"
+};
+
+RunStats::RunStats() : m_start( std::chrono::steady_clock::now() )
+{
+    for (size_t i = 0; i < NUMBER_OF_RUN_COUNTERS; i++)
+    {
+        m_counters[i] = 0;
+    }
+
+    for (size_t i = 0; i < NUMBER_OF_RUN_STAGES; i++)
+    {
+        m_stage_nanoseconds[i] = 0;
+        m_stage_calls[i] = 0;
+    }
+}
+
+RunStats&
+RunStats::get()
+{
+    static RunStats run_stats;
+    return run_stats;
+}
+
+uint64_t
+RunStats::getPeakRssKilobytes()
+{
+#ifndef _WIN32
+    struct rusage usage;
+
+    if ( getrusage(RUSAGE_SELF, &usage) == 0 )
+    {
+        // Linux reports kilobytes, macOS bytes
+#ifdef __APPLE__
+        return uint64_t(usage.ru_maxrss) / 1024;
+#else
+        return uint64_t(usage.ru_maxrss);
+#endif
+    }
+#endif
+
+    return 0;
+}
+
+void
+RunStats::print(std::ostream& out) const
+{
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - m_start;
+
+    out << "Stage, Milliseconds, Calls" << std::endl;
+
+    for (size_t i = 0; i < NUMBER_OF_RUN_STAGES; i++)
+    {
+        out << STAGE_NAMES[i] << ", " << double( m_stage_nanoseconds[i] ) / 1e6 << ", " << m_stage_calls[i] << std::endl;
+    }
+
+    out << "total, " << double( elapsed.count() ) / 1e6 << ", 1" << std::endl;
+
+    for (size_t i = 0; i < NUMBER_OF_RUN_COUNTERS; i++)
+    {
+        out << COUNTER_NAMES[i] << " " << m_counters[i] << std::endl;
+    }
+
+    out << "peak_rss_kb " << getPeakRssKilobytes() << std::endl;
+}
+
+void
+RunStats::printJson(std::ostream& out) const
+{
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - m_start;
+
+    out << "{\"stages\":{";
+
+    for (size_t i = 0; i < NUMBER_OF_RUN_STAGES; i++)
+    {
+        out << (i ? "," : "") << "\"" << STAGE_NAMES[i] << "\":{\"ms\":" << double( m_stage_nanoseconds[i] ) / 1e6 << ",\"calls\":" << m_stage_calls[i] << "}";
+    }
+
+    out << "},\"total_ms\":" << double( elapsed.count() ) / 1e6 << ",\"counters\":{";
+
+    for (size_t i = 0; i < NUMBER_OF_RUN_COUNTERS; i++)
+    {
+        out << (i ? "," : "") << "\"" << COUNTER_NAMES[i] << "\":" << m_counters[i];
+    }
+
+    out << "},\"peak_rss_kb\":" << getPeakRssKilobytes() << "}" << std::endl;
+}
+
+RunStatsReport::~RunStatsReport()
+{
+    if ( m_destination.empty() || m_destination == "0" )
+    {
+        return;
+    }
+
+    if (m_destination == "1")
+    {
+        RunStats::get().print(std::cerr);
+        return;
+    }
+
+    std::ofstream json_file( m_destination.c_str() );
+
+    if ( !json_file.is_open() )
+    {
+        std::cerr << "Unable to write " << m_destination << std::endl;
+        return;
+    }
+
+    RunStats::get().printJson(json_file);
+}
@@ -0,0 +1,112 @@
+//--------------------------------------------------------------------------------------
+// RunStats.h
+// Timers and counters for seeing where a run spends its time. Stages are
+// timed with a StageTimer on the stack, counters are bumped directly. Both
+// are process wide and atomic, so worker threads add to them as they go;
+// hot loops count into locals and add once at the end. With several queries
+// running at once a stage's time is the sum over the threads, so it can
+// exceed the wall time.
+
+#ifndef RUN_STATS_H_INCLUDED
+#define RUN_STATS_H_INCLUDED
+
+#include <string>
+#include <ostream>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+enum RunStage
+{
+    STAGE_INGEST,                   // parsing daily records into partial hierarchies
+    STAGE_MERGE,                    // merging the partial hierarchies into one
+    STAGE_SNAPSHOT_READ,
+    STAGE_SNAPSHOT_WRITE,
+    STAGE_DELTA,
+    STAGE_MONTHLY_PARSE,
+    STAGE_RECORD_SEARCH,            // the record counting pass, or building its saved state
+    STAGE_RANKING,                  // ranking rolling windows
+    STAGE_OUTPUT,                   // formatting the report, rankings included
+    NUMBER_OF_RUN_STAGES
+};
+
+enum RunCounter
+{
+    COUNTER_INPUT_BYTES,
+    COUNTER_LINES,
+    COUNTER_RECORDS,                // lines decoded into a record
+    COUNTER_SHORT_LINES,            // daily lines under DataRecord::MINIMUM_RECORD_LENGTH
+    COUNTER_REJECTED_LINES,         // lines that didn't decode, short ones included
+    COUNTER_STATIONS_SEARCHED,
+    COUNTER_QUERIES,
+    NUMBER_OF_RUN_COUNTERS
+};
+
+class RunStats
+{
+public:
+    // The one instance, created on first use. The run's wall time is
+    // measured from then.
+    static RunStats&        get();
+
+    void                    add(RunCounter counter, uint64_t value) { m_counters[counter] += value; }
+    void                    addTime(RunStage stage, uint64_t nanoseconds) { m_stage_nanoseconds[stage] += nanoseconds; m_stage_calls[stage]++; }
+
+    // Largest resident set so far, in kilobytes, 0 where it isn't known
+    static uint64_t         getPeakRssKilobytes();
+
+    // One "name value" line per stage and counter
+    void                    print(std::ostream& out) const;
+
+    // The same as a single JSON object
+    void                    printJson(std::ostream& out) const;
+
+private:
+                            RunStats();
+
+    std::chrono::steady_clock::time_point m_start;
+    std::atomic<uint64_t>   m_counters[NUMBER_OF_RUN_COUNTERS];
+    std::atomic<uint64_t>   m_stage_nanoseconds[NUMBER_OF_RUN_STAGES];
+    std::atomic<uint64_t>   m_stage_calls[NUMBER_OF_RUN_STAGES];
+};
+
+// Adds the time from construction to destruction, or to stop() if that
+// comes first, to a stage
+class StageTimer
+{
+public:
+                            StageTimer(RunStage stage) : m_stage(stage), m_start( std::chrono::steady_clock::now() ), m_running(true) {}
+                            ~StageTimer() { stop(); }
+
+    void                    stop()
+                            {
+                                if (m_running)
+                                {
+                                    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - m_start;
+                                    RunStats::get().addTime( m_stage, uint64_t( elapsed.count() ) );
+                                    m_running = false;
+                                }
+                            }
+
+private:
+    RunStage                m_stage;
+    std::chrono::steady_clock::time_point m_start;
+    bool                    m_running;
+};
+
+// Reports the stats when it goes out of scope, so every way out of main
+// reports. stats=1 prints them to stderr, any other value except 0 is a
+// file name to write them to as JSON.
+class RunStatsReport
+{
+public:
+                            RunStatsReport() { RunStats::get(); }
+                            ~RunStatsReport();
+
+    void                    setDestination(const std::string& destination) { m_destination = destination; }
+
+private:
+    std::string             m_destination;
+};
+
+#endif // RUN_STATS_H_INCLUDED
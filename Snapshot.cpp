@@ -0,0 +1,495 @@
+//--------------------------------------------------------------------------------------
+// Snapshot.cpp
+// Binary snapshot of a parsed daily archive, see Snapshot.h for the layout.
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utility>
+
+#include "Snapshot.h"
+#include "MappedFile.h"
+#include "RunStats.h"
+
+static const char           SNAPSHOT_MAGIC[8] = { 'U', 'S', 'H', 'C', 'N', 'S', 'N', 'P' };
+static const uint32_t       SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+static const size_t         SNAPSHOT_HEADER_SIZE = 80;
+
+static uint64_t
+checksumBytes(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Appends fields to an in memory payload
+class SnapshotWriter
+{
+public:
+    std::vector<char>&      getBuffer() { return m_buffer; }
+
+    void                    putBytes(const void* data, size_t size)
+                            {
+                                const char* bytes = (const char*)data;
+                                m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+                            }
+
+    template<typename T>
+    void                    put(T value) { putBytes(&value, sizeof(T)); }
+
+    void                    putString(const std::string& value)
+                            {
+                                put<uint32_t>( uint32_t( value.size() ) );
+                                putBytes( value.data(), value.size() );
+                            }
+
+protected:
+    std::vector<char>       m_buffer;
+};
+
+// Reads fields back out of a mapped payload. Running off the end sets the
+// failed flag and returns zeros, so a truncated file is caught once at the end.
+class SnapshotReader
+{
+public:
+                            SnapshotReader(const char* data, size_t size) :
+                                            m_data(data), m_size(size), m_position(0), m_failed(false) {}
+
+    bool                    getFailed() { return m_failed; }
+
+    const char*             getBytes(size_t size)
+                            {
+                                if ( m_failed || size > m_size - m_position )
+                                {
+                                    m_failed = true;
+                                    return NULL;
+                                }
+
+                                const char* bytes = m_data + m_position;
+                                m_position += size;
+                                return bytes;
+                            }
+
+    template<typename T>
+    T                       get()
+                            {
+                                T value = T();
+                                const char* bytes = getBytes( sizeof(T) );
+
+                                if (bytes != NULL)
+                                {
+                                    memcpy(&value, bytes, sizeof(T));
+                                }
+
+                                return value;
+                            }
+
+    std::string             getString()
+                            {
+                                uint32_t size = get<uint32_t>();
+                                const char* bytes = getBytes(size);
+                                return (bytes == NULL) ? std::string() : std::string(bytes, size);
+                            }
+
+protected:
+    const char*             m_data;
+    size_t                  m_size;
+    size_t                  m_position;
+    bool                    m_failed;
+};
+
+bool
+getSnapshotKey(const std::string& data_file_name, const std::string& station_file_name, SnapshotKey& key)
+{
+    struct stat data_file_status;
+    struct stat station_file_status;
+
+    if (   stat(data_file_name.c_str(), &data_file_status) != 0
+        || stat(station_file_name.c_str(), &station_file_status) != 0 )
+    {
+        return false;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.data_file_size = uint64_t(data_file_status.st_size);
+    key.data_file_mtime = int64_t(data_file_status.st_mtime);
+    key.station_file_size = uint64_t(station_file_status.st_size);
+    key.station_file_mtime = int64_t(station_file_status.st_mtime);
+    return true;
+}
+
+bool
+addDeltaToSnapshotKey(const std::string& delta_file_name, SnapshotKey& key)
+{
+    struct stat delta_file_status;
+
+    if ( stat(delta_file_name.c_str(), &delta_file_status) != 0 )
+    {
+        return false;
+    }
+
+    key.delta_file_size = uint64_t(delta_file_status.st_size);
+    key.delta_file_mtime = int64_t(delta_file_status.st_mtime);
+    return true;
+}
+
+bool
+writeSnapshot(const std::string& snapshot_file_name, const SnapshotKey& key, Country& US,
+              const std::vector<unsigned int>& state_transition_vector, size_t most_recent_year,
+              const RecordStateMap& record_state_map)
+{
+    StageTimer timer(STAGE_SNAPSHOT_WRITE);
+    SnapshotWriter payload;
+
+    payload.put<uint64_t>(most_recent_year);
+    payload.put<uint32_t>( uint32_t( state_transition_vector.size() ) );
+
+    for (size_t i = 0; i < state_transition_vector.size(); i++)
+    {
+        payload.put<uint32_t>( state_transition_vector[i] );
+    }
+
+    payload.put<float>( US.getRecordMaxTemperature() );
+    payload.put<float>( US.getRecordMinTemperature() );
+    payload.put<uint32_t>( US.getRecordMaxYear() );
+    payload.put<uint32_t>( US.getRecordMinYear() );
+    payload.put<uint8_t>( US.getCompactStorage() ? 1 : 0 );
+
+    std::vector<State>& state_vector = US.getStateVector();
+    payload.put<uint32_t>( uint32_t( state_vector.size() ) );
+
+    for (size_t state_number = 0; state_number < state_vector.size(); state_number++)
+    {
+        State& state = state_vector[state_number];
+        std::vector<Station>& station_vector = state.getStationVector();
+
+        payload.put<uint32_t>( state.getStateNumber() );
+        payload.put<float>( state.getRecordMaxTemperature() );
+        payload.put<float>( state.getRecordMinTemperature() );
+        payload.put<uint32_t>( state.getRecordMaxYear() );
+        payload.put<uint32_t>( state.getRecordMinYear() );
+        payload.put<uint32_t>( uint32_t( station_vector.size() ) );
+
+        for (size_t station_number = 0; station_number < station_vector.size(); station_number++)
+        {
+            Station& station = station_vector[station_number];
+            std::vector<Year>& year_vector = station.getYearVector();
+            DailyColumns& daily_columns = station.getDailyColumns();
+
+            payload.put<uint32_t>( station.getStationNumber() );
+            payload.putString( station.getStationName() );
+            payload.putString( station.getStateName() );
+            payload.put<float>( station.getRecordMaxTemperature() );
+            payload.put<float>( station.getRecordMinTemperature() );
+            payload.put<uint32_t>( station.getRecordMaxYear() );
+            payload.put<uint32_t>( station.getRecordMinYear() );
+            payload.put<uint32_t>( uint32_t( year_vector.size() ) );
+
+            for (size_t year_index = 0; year_index < year_vector.size(); year_index++)
+            {
+                Year& year = year_vector[year_index];
+
+                payload.put<uint32_t>( year.getYear() );
+                payload.put<float>( year.getRecordMaxTemperature() );
+                payload.put<float>( year.getRecordMinTemperature() );
+                payload.put<uint32_t>( year.getRecordMaxMonth() );
+                payload.put<uint32_t>( year.getRecordMinMonth() );
+                payload.put<float>( year.getTotalTemperature() );
+                payload.put<uint32_t>( year.getNumberOfTemperatures() );
+
+                for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+                {
+                    Month& current_month = year.getMonth(month);
+
+                    payload.put<uint8_t>( current_month.getValid() ? 1 : 0 );
+                    payload.put<float>( current_month.getRecordMaxTemperature() );
+                    payload.put<float>( current_month.getRecordMinTemperature() );
+                    payload.put<uint32_t>( current_month.getRecordMaxDay() );
+                    payload.put<uint32_t>( current_month.getRecordMinDay() );
+                    payload.put<float>( current_month.getTotalTemperature() );
+                    payload.put<uint32_t>( current_month.getNumberOfTemperatures() );
+                }
+            }
+
+            // The columns always cover exactly the station's years
+            payload.putBytes( daily_columns.getMaxTemperatureData(), daily_columns.getNumberOfSlots() * daily_columns.getTemperatureSize() );
+            payload.putBytes( daily_columns.getMinTemperatureData(), daily_columns.getNumberOfSlots() * daily_columns.getTemperatureSize() );
+        }
+    }
+
+    // Stations go in number order, so the same states always make the
+    // same file
+    std::vector<unsigned int> record_station_vector;
+
+    for (RecordStateMap::const_iterator state_it = record_state_map.begin(); state_it != record_state_map.end(); ++state_it)
+    {
+        record_station_vector.push_back(state_it->first);
+    }
+
+    std::sort( record_station_vector.begin(), record_station_vector.end() );
+    payload.put<uint32_t>( uint32_t( record_station_vector.size() ) );
+
+    for (size_t i = 0; i < record_station_vector.size(); i++)
+    {
+        const StationRecordState& record_state = record_state_map.find( record_station_vector[i] )->second;
+        const RecordTable& record_table = record_state.record_table;
+
+        payload.put<uint32_t>( record_station_vector[i] );
+        payload.put<uint64_t>(record_state.scanned_slots);
+        payload.putBytes( record_table.getRecordTemperatureData(), RecordTable::NUMBER_OF_CELLS * sizeof(float) );
+        payload.putBytes( record_table.getYearStartData(), (RecordTable::NUMBER_OF_CELLS + 1) * sizeof(uint32_t) );
+        payload.put<uint32_t>( uint32_t( record_table.getYearVector().size() ) );
+        payload.putBytes( record_table.getYearVector().data(), record_table.getYearVector().size() * sizeof(uint16_t) );
+        payload.put<uint32_t>( uint32_t( record_state.year_totals_vector.size() ) );
+        payload.putBytes( record_state.year_totals_vector.data(), record_state.year_totals_vector.size() * sizeof(StationYearTotals) );
+    }
+
+    std::vector<char>& payload_buffer = payload.getBuffer();
+    SnapshotWriter header;
+    header.putBytes( SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) );
+    header.put<uint32_t>(SNAPSHOT_VERSION);
+    header.put<uint32_t>(SNAPSHOT_BYTE_ORDER_MARK);
+    header.put<uint64_t>(key.data_file_size);
+    header.put<int64_t>(key.data_file_mtime);
+    header.put<uint64_t>(key.station_file_size);
+    header.put<int64_t>(key.station_file_mtime);
+    header.put<uint64_t>(key.delta_file_size);
+    header.put<int64_t>(key.delta_file_mtime);
+    header.put<uint64_t>( payload_buffer.size() );
+    header.put<uint64_t>( checksumBytes( payload_buffer.data(), payload_buffer.size() ) );
+
+    std::string temporary_file_name = snapshot_file_name + ".tmp";
+    FILE* snapshot_file = fopen(temporary_file_name.c_str(), "wb");
+
+    if (snapshot_file == NULL)
+    {
+        return false;
+    }
+
+    bool written =    fwrite( header.getBuffer().data(), 1, header.getBuffer().size(), snapshot_file ) == header.getBuffer().size()
+                   && fwrite( payload_buffer.data(), 1, payload_buffer.size(), snapshot_file ) == payload_buffer.size();
+
+    if ( fclose(snapshot_file) != 0 || !written || rename( temporary_file_name.c_str(), snapshot_file_name.c_str() ) != 0 )
+    {
+        remove( temporary_file_name.c_str() );
+        return false;
+    }
+
+    return true;
+}
+
+bool
+readSnapshot(const std::string& snapshot_file_name, const SnapshotKey& key, Country& US,
+             std::vector<unsigned int>& state_transition_vector, size_t& most_recent_year,
+             RecordStateMap& record_state_map)
+{
+    StageTimer timer(STAGE_SNAPSHOT_READ);
+    MappedFile snapshot_file;
+
+    if ( !snapshot_file.open(snapshot_file_name) || snapshot_file.getSize() < SNAPSHOT_HEADER_SIZE )
+    {
+        return false;
+    }
+
+    SnapshotReader header( snapshot_file.getData(), SNAPSHOT_HEADER_SIZE );
+
+    if (   memcmp( header.getBytes( sizeof(SNAPSHOT_MAGIC) ), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) ) != 0
+        || header.get<uint32_t>() != SNAPSHOT_VERSION
+        || header.get<uint32_t>() != SNAPSHOT_BYTE_ORDER_MARK
+        || header.get<uint64_t>() != key.data_file_size
+        || header.get<int64_t>() != key.data_file_mtime
+        || header.get<uint64_t>() != key.station_file_size
+        || header.get<int64_t>() != key.station_file_mtime
+        || header.get<uint64_t>() != key.delta_file_size
+        || header.get<int64_t>() != key.delta_file_mtime )
+    {
+        return false;
+    }
+
+    uint64_t payload_size = header.get<uint64_t>();
+    uint64_t payload_checksum = header.get<uint64_t>();
+    const char* payload_data = snapshot_file.getData() + SNAPSHOT_HEADER_SIZE;
+
+    if (   payload_size != snapshot_file.getSize() - SNAPSHOT_HEADER_SIZE
+        || checksumBytes(payload_data, payload_size) != payload_checksum )
+    {
+        return false;
+    }
+
+    SnapshotReader payload(payload_data, payload_size);
+    Country loaded_US;
+    std::vector<unsigned int> loaded_transition_vector;
+
+    size_t loaded_most_recent_year = payload.get<uint64_t>();
+    uint32_t number_of_transitions = payload.get<uint32_t>();
+
+    for (uint32_t i = 0; i < number_of_transitions && !payload.getFailed(); i++)
+    {
+        loaded_transition_vector.push_back( payload.get<uint32_t>() );
+    }
+
+    loaded_US.setRecordMaxTemperature( payload.get<float>() );
+    loaded_US.setRecordMinTemperature( payload.get<float>() );
+    loaded_US.setRecordMaxYear( payload.get<uint32_t>() );
+    loaded_US.setRecordMinYear( payload.get<uint32_t>() );
+
+    // A snapshot with the other kind of columns is no use, it gets rebuilt
+    bool compact_storage = ( payload.get<uint8_t>() != 0 );
+
+    if ( compact_storage != US.getCompactStorage() )
+    {
+        return false;
+    }
+
+    loaded_US.setCompactStorage(compact_storage);
+
+    std::vector<State>& state_vector = loaded_US.getStateVector();
+
+    if ( payload.get<uint32_t>() != state_vector.size() )
+    {
+        return false;
+    }
+
+    for (size_t state_number = 0; state_number < state_vector.size() && !payload.getFailed(); state_number++)
+    {
+        State& state = state_vector[state_number];
+        std::vector<Station>& station_vector = state.getStationVector();
+
+        state.setStateNumber( payload.get<uint32_t>() );
+        state.setRecordMaxTemperature( payload.get<float>() );
+        state.setRecordMinTemperature( payload.get<float>() );
+        state.setRecordMaxYear( payload.get<uint32_t>() );
+        state.setRecordMinYear( payload.get<uint32_t>() );
+        uint32_t number_of_stations = payload.get<uint32_t>();
+
+        for (uint32_t station_number = 0; station_number < number_of_stations && !payload.getFailed(); station_number++)
+        {
+            station_vector.push_back( Station() );
+            Station& station = station_vector.back();
+            std::vector<Year>& year_vector = station.getYearVector();
+            DailyColumns& daily_columns = station.getDailyColumns();
+
+            station.setStationNumber( payload.get<uint32_t>() );
+            station.setStationName( payload.getString() );
+            station.setStateName( payload.getString() );
+            station.setRecordMaxTemperature( payload.get<float>() );
+            station.setRecordMinTemperature( payload.get<float>() );
+            station.setRecordMaxYear( payload.get<uint32_t>() );
+            station.setRecordMinYear( payload.get<uint32_t>() );
+            uint32_t number_of_years = payload.get<uint32_t>();
+
+            for (uint32_t year_index = 0; year_index < number_of_years && !payload.getFailed(); year_index++)
+            {
+                year_vector.push_back( Year() );
+                Year& year = year_vector.back();
+
+                year.setYear( payload.get<uint32_t>() );
+                year.setRecordMaxTemperature( payload.get<float>() );
+                year.setRecordMinTemperature( payload.get<float>() );
+                year.setRecordMaxMonth( payload.get<uint32_t>() );
+                year.setRecordMinMonth( payload.get<uint32_t>() );
+                year.setTotalTemperature( payload.get<float>() );
+                year.setNumberOfTemperatures( payload.get<uint32_t>() );
+
+                for (size_t month = 0; month < NUMBER_OF_MONTHS_PER_YEAR; month++)
+                {
+                    Month& current_month = year.getMonth(month);
+
+                    current_month.setValid( payload.get<uint8_t>() != 0 );
+                    current_month.setRecordMaxTemperature( payload.get<float>() );
+                    current_month.setRecordMinTemperature( payload.get<float>() );
+                    current_month.setRecordMaxDay( payload.get<uint32_t>() );
+                    current_month.setRecordMinDay( payload.get<uint32_t>() );
+                    current_month.setTotalTemperature( payload.get<float>() );
+                    current_month.setNumberOfTemperatures( payload.get<uint32_t>() );
+                }
+            }
+
+            if ( payload.getFailed() )
+            {
+                break;
+            }
+
+            // Copy the columns straight out of the mapping
+            daily_columns.setCompact(compact_storage);
+            daily_columns.resize( year_vector.size() );
+            size_t temperature_bytes = daily_columns.getNumberOfSlots() * daily_columns.getTemperatureSize();
+            const char* max_temperatures = payload.getBytes(temperature_bytes);
+            const char* min_temperatures = payload.getBytes(temperature_bytes);
+
+            if ( payload.getFailed() || year_vector.empty() )
+            {
+                continue;
+            }
+
+            memcpy(daily_columns.getMaxTemperatureData(), max_temperatures, temperature_bytes);
+            memcpy(daily_columns.getMinTemperatureData(), min_temperatures, temperature_bytes);
+        }
+    }
+
+    RecordStateMap loaded_record_state_map;
+    uint32_t number_of_record_states = payload.get<uint32_t>();
+
+    for (uint32_t state_index = 0; state_index < number_of_record_states && !payload.getFailed(); state_index++)
+    {
+        StationRecordState& record_state = loaded_record_state_map[ payload.get<uint32_t>() ];
+        RecordTable& record_table = record_state.record_table;
+        record_state.scanned_slots = payload.get<uint64_t>();
+        const char* record_temperatures = payload.getBytes( RecordTable::NUMBER_OF_CELLS * sizeof(float) );
+        const char* year_starts = payload.getBytes( (RecordTable::NUMBER_OF_CELLS + 1) * sizeof(uint32_t) );
+        uint32_t number_of_years = payload.get<uint32_t>();
+        const char* years = payload.getBytes( number_of_years * sizeof(uint16_t) );
+
+        if ( payload.getFailed() )
+        {
+            break;
+        }
+
+        memcpy( record_table.getRecordTemperatureData(), record_temperatures, RecordTable::NUMBER_OF_CELLS * sizeof(float) );
+        memcpy( record_table.getYearStartData(), year_starts, (RecordTable::NUMBER_OF_CELLS + 1) * sizeof(uint32_t) );
+        record_table.getYearVector().resize(number_of_years);
+
+        if (number_of_years)
+        {
+            memcpy( record_table.getYearVector().data(), years, number_of_years * sizeof(uint16_t) );
+        }
+
+        if ( !record_table.isConsistent() )
+        {
+            return false;
+        }
+
+        uint32_t number_of_year_totals = payload.get<uint32_t>();
+        const char* year_totals = payload.getBytes( number_of_year_totals * sizeof(StationYearTotals) );
+
+        if ( payload.getFailed() )
+        {
+            break;
+        }
+
+        record_state.year_totals_vector.resize(number_of_year_totals);
+
+        if (number_of_year_totals)
+        {
+            memcpy( record_state.year_totals_vector.data(), year_totals, number_of_year_totals * sizeof(StationYearTotals) );
+        }
+    }
+
+    if ( payload.getFailed() )
+    {
+        return false;
+    }
+
+    US = std::move(loaded_US);
+    record_state_map.swap(loaded_record_state_map);
+    state_transition_vector.swap(loaded_transition_vector);
+    most_recent_year = loaded_most_recent_year;
+    return true;
+}
@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Snapshot.h
+// Binary snapshot of a parsed daily archive, so later runs can skip
+// re-reading the text files when only the query arguments change.
+//
+// File layout, native byte order (the byte order mark rejects a foreign file):
+//
+//   offset  size  field
+//        0     8  magic "USHCNSNP"
+//        8     4  uint32 format version (SNAPSHOT_VERSION)
+//       12     4  uint32 byte order mark 0x01020304
+//       16    48  SnapshotKey : data file size, mtime, station file size, mtime,
+//                 delta file size, mtime (zero without a delta)
+//       64     8  uint64 payload size in bytes
+//       72     8  uint64 FNV-1a checksum of the payload
+//       80     -  payload
+//
+// The payload holds the most recent year, the state names in the order they
+// were printed, the Country, State, Station, Year and Month records, and for
+// each station its DailyColumns TMAX/TMIN arrays. The Country record ends
+// with a byte that is 1 when the arrays are compact int16s rather than floats.
+// After that comes the saved record search (see RecordSearch.h): for each
+// station, in number order, its number, scanned slots (uint64), its
+// RecordTable's 744 record temperatures (floats) and 745 year offsets
+// (uint32), the count and uint16s of its year array, and its
+// StationYearTotals as raw structs.
+// Strings are a uint32 length followed by the bytes, counts are uint32.
+
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "USHCN.h"
+#include "RecordSearch.h"
+
+static const uint32_t       SNAPSHOT_VERSION = 6;
+
+// Identifies the source files a snapshot was built from. A snapshot with a
+// delta applied carries the delta file too, so a run without that delta
+// doesn't pick it up.
+struct SnapshotKey
+{
+    uint64_t                data_file_size;
+    int64_t                 data_file_mtime;
+    uint64_t                station_file_size;
+    int64_t                 station_file_mtime;
+    uint64_t                delta_file_size;
+    int64_t                 delta_file_mtime;
+};
+
+// Fills in key from the two source files, with no delta, false if either
+// can't be found
+bool getSnapshotKey(const std::string& data_file_name, const std::string& station_file_name, SnapshotKey& key);
+
+// Add the delta file applied on top of the data file to key, false if it
+// can't be found
+bool addDeltaToSnapshotKey(const std::string& delta_file_name, SnapshotKey& key);
+
+// Write US and its record search state out to snapshot_file_name. The file is
+// written under a temporary name and renamed into place, so a reader never
+// sees half a snapshot.
+bool writeSnapshot(const std::string& snapshot_file_name, const SnapshotKey& key, Country& US,
+                   const std::vector<unsigned int>& state_transition_vector, size_t most_recent_year,
+                   const RecordStateMap& record_state_map);
+
+// Load a snapshot into an empty US. Returns false, leaving US untouched, if the
+// file is missing, from another version, doesn't match key, fails its checksum
+// or doesn't have the kind of columns US.getCompactStorage() asks for.
+bool readSnapshot(const std::string& snapshot_file_name, const SnapshotKey& key, Country& US,
+                  std::vector<unsigned int>& state_transition_vector, size_t& most_recent_year,
+                  RecordStateMap& record_state_map);
+
+#endif // SNAPSHOT_H_INCLUDED
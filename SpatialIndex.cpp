@@ -0,0 +1,160 @@
+//--------------------------------------------------------------------------------------
+// SpatialIndex.cpp
+// Latitude / longitude grid over the station catalog, see SpatialIndex.h
+
+#include <algorithm>
+#include <math.h>
+
+#include "SpatialIndex.h"
+
+static const double         DEGREES_TO_RADIANS = 3.14159265358979323846 / 180.0;
+
+double
+getDistanceKm(double latitude_1, double longitude_1, double latitude_2, double longitude_2)
+{
+    // Haversine, which stays accurate for stations close together
+    double delta_latitude = (latitude_2 - latitude_1) * DEGREES_TO_RADIANS;
+    double delta_longitude = (longitude_2 - longitude_1) * DEGREES_TO_RADIANS;
+    double a = sin(delta_latitude / 2.0) * sin(delta_latitude / 2.0)
+             + cos(latitude_1 * DEGREES_TO_RADIANS) * cos(latitude_2 * DEGREES_TO_RADIANS) * sin(delta_longitude / 2.0) * sin(delta_longitude / 2.0);
+
+    return 2.0 * EARTH_RADIUS_KM * asin( std::min( 1.0, sqrt(a) ) );
+}
+
+// Cell row of a latitude, clamped to the grid
+size_t
+SpatialIndex::getRow(float latitude) const
+{
+    float row = floorf( (latitude - m_min_latitude) / m_cell_size );
+    return (row <= 0.0f) ? 0 : std::min( size_t(row), m_number_of_rows - 1 );
+}
+
+size_t
+SpatialIndex::getColumn(float longitude) const
+{
+    float column = floorf( (longitude - m_min_longitude) / m_cell_size );
+    return (column <= 0.0f) ? 0 : std::min( size_t(column), m_number_of_columns - 1 );
+}
+
+void
+SpatialIndex::build(const StationCatalog& catalog, float cell_size_degrees)
+{
+    m_catalog = &catalog;
+    m_cell_size = cell_size_degrees;
+    m_cell_start_vector.clear();
+    m_station_id_vector.clear();
+    m_number_of_rows = 0;
+    m_number_of_columns = 0;
+
+    if ( catalog.empty() )
+    {
+        return;
+    }
+
+    float max_latitude = catalog[0].latitude;
+    float max_longitude = catalog[0].longitude;
+    m_min_latitude = max_latitude;
+    m_min_longitude = max_longitude;
+
+    for (size_t station_id = 1; station_id < catalog.size(); station_id++)
+    {
+        m_min_latitude = std::min( m_min_latitude, catalog[station_id].latitude );
+        m_min_longitude = std::min( m_min_longitude, catalog[station_id].longitude );
+        max_latitude = std::max( max_latitude, catalog[station_id].latitude );
+        max_longitude = std::max( max_longitude, catalog[station_id].longitude );
+    }
+
+    m_number_of_rows = size_t( (max_latitude - m_min_latitude) / m_cell_size ) + 1;
+    m_number_of_columns = size_t( (max_longitude - m_min_longitude) / m_cell_size ) + 1;
+
+    // Count the stations per cell, turn the counts into offsets, then fill
+    // in. Going through the stations in id order keeps every cell sorted.
+    size_t number_of_cells = m_number_of_rows * m_number_of_columns;
+    std::vector<size_t> cell_vector( catalog.size() );
+    m_cell_start_vector.assign(number_of_cells + 1, 0);
+
+    for (size_t station_id = 0; station_id < catalog.size(); station_id++)
+    {
+        cell_vector[station_id] = ( getRow( catalog[station_id].latitude ) * m_number_of_columns ) + getColumn( catalog[station_id].longitude );
+        m_cell_start_vector[ cell_vector[station_id] + 1 ]++;
+    }
+
+    for (size_t cell = 0; cell < number_of_cells; cell++)
+    {
+        m_cell_start_vector[cell + 1] += m_cell_start_vector[cell];
+    }
+
+    std::vector<size_t> cell_fill_vector( m_cell_start_vector.begin(), m_cell_start_vector.end() - 1 );
+    m_station_id_vector.resize( catalog.size() );
+
+    for (size_t station_id = 0; station_id < catalog.size(); station_id++)
+    {
+        m_station_id_vector[ cell_fill_vector[ cell_vector[station_id] ]++ ] = (unsigned int)station_id;
+    }
+}
+
+void
+SpatialIndex::findInBox(float min_latitude, float min_longitude, float max_latitude, float max_longitude,
+                        std::vector<size_t>& station_id_vector) const
+{
+    station_id_vector.clear();
+
+    if ( m_catalog == NULL || m_station_id_vector.empty() || min_latitude > max_latitude || min_longitude > max_longitude )
+    {
+        return;
+    }
+
+    const StationCatalog& catalog = *m_catalog;
+    size_t first_row = getRow(min_latitude);
+    size_t last_row = getRow(max_latitude);
+    size_t first_column = getColumn(min_longitude);
+    size_t last_column = getColumn(max_longitude);
+
+    for (size_t row = first_row; row <= last_row; row++)
+    {
+        for (size_t column = first_column; column <= last_column; column++)
+        {
+            size_t cell = (row * m_number_of_columns) + column;
+
+            for (size_t i = m_cell_start_vector[cell]; i < m_cell_start_vector[cell + 1]; i++)
+            {
+                const StationInfo& info = catalog[ m_station_id_vector[i] ];
+
+                if (   info.latitude >= min_latitude && info.latitude <= max_latitude
+                    && info.longitude >= min_longitude && info.longitude <= max_longitude )
+                {
+                    station_id_vector.push_back( m_station_id_vector[i] );
+                }
+            }
+        }
+    }
+
+    std::sort( station_id_vector.begin(), station_id_vector.end() );
+}
+
+void
+SpatialIndex::findNear(float latitude, float longitude, float radius_km, std::vector<size_t>& station_id_vector) const
+{
+    // Search the box around the circle, then keep what's really inside it.
+    // A degree of latitude is the same everywhere, one of longitude shrinks
+    // towards the poles.
+    double kilometres_per_degree = EARTH_RADIUS_KM * DEGREES_TO_RADIANS;
+    double latitude_span = radius_km / kilometres_per_degree;
+    double cosine = cos( std::min( fabs(latitude) + latitude_span, 90.0 ) * DEGREES_TO_RADIANS );
+    double longitude_span = (cosine > 1e-6) ? radius_km / (kilometres_per_degree * cosine) : 360.0;
+    std::vector<size_t> candidate_vector;
+
+    findInBox( float(latitude - latitude_span), float(longitude - longitude_span), float(latitude + latitude_span), float(longitude + longitude_span),
+               candidate_vector );
+    station_id_vector.clear();
+
+    for (size_t i = 0; i < candidate_vector.size(); i++)
+    {
+        const StationInfo& info = (*m_catalog)[ candidate_vector[i] ];
+
+        if ( getDistanceKm(latitude, longitude, info.latitude, info.longitude) <= radius_km )
+        {
+            station_id_vector.push_back( candidate_vector[i] );
+        }
+    }
+}
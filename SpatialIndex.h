@@ -0,0 +1,52 @@
+//--------------------------------------------------------------------------------------
+// SpatialIndex.h
+// Grid over the station catalog's coordinates for radius and bounding box
+// searches. Stations are bucketed into square cells of latitude and
+// longitude, stored as one flat array of dense station ids with an offset
+// per cell, so a search only looks at the cells its box overlaps.
+// Longitudes don't wrap at the date line, which no USHCN station is near.
+
+#ifndef SPATIAL_INDEX_H_INCLUDED
+#define SPATIAL_INDEX_H_INCLUDED
+
+#include <vector>
+#include <stddef.h>
+
+#include "StationCatalog.h"
+
+static const double         EARTH_RADIUS_KM = 6371.0088;
+
+// Great circle distance between two points given in degrees
+double getDistanceKm(double latitude_1, double longitude_1, double latitude_2, double longitude_2);
+
+class SpatialIndex
+{
+public:
+                            SpatialIndex() : m_catalog(NULL), m_cell_size(1.0f), m_min_latitude(0.0f), m_min_longitude(0.0f),
+                                             m_number_of_rows(0), m_number_of_columns(0) {}
+
+    // Index every station in catalog, which has to outlive the index
+    void                    build(const StationCatalog& catalog, float cell_size_degrees = 1.0f);
+
+    // Dense ids of the stations inside the box, edges included, in id order
+    void                    findInBox(float min_latitude, float min_longitude, float max_latitude, float max_longitude,
+                                      std::vector<size_t>& station_id_vector) const;
+
+    // Dense ids of the stations within radius_km of a point, in id order
+    void                    findNear(float latitude, float longitude, float radius_km, std::vector<size_t>& station_id_vector) const;
+
+protected:
+    size_t                  getRow(float latitude) const;
+    size_t                  getColumn(float longitude) const;
+
+    const StationCatalog*   m_catalog;
+    float                   m_cell_size;
+    float                   m_min_latitude;
+    float                   m_min_longitude;
+    size_t                  m_number_of_rows;
+    size_t                  m_number_of_columns;
+    std::vector<size_t>     m_cell_start_vector;    // rows * columns + 1 offsets into m_station_id_vector
+    std::vector<unsigned int> m_station_id_vector;
+};
+
+#endif // SPATIAL_INDEX_H_INCLUDED
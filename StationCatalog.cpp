@@ -0,0 +1,105 @@
+//--------------------------------------------------------------------------------------
+// StationCatalog.cpp
+// Parsing and lookup for ushcn-stations.txt, see StationCatalog.h for the columns
+
+#include <fstream>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StationCatalog.h"
+
+// Shortest line that holds every column, through the UTC offset
+static const size_t         MINIMUM_STATION_LINE_LENGTH = 90;
+
+static bool
+isStationNumberLess(const StationInfo& left, const StationInfo& right)
+{
+    return left.station_number < right.station_number;
+}
+
+// A component column holds a COOP ID or ------
+static unsigned int
+parseComponent(const std::string& line, size_t position)
+{
+    return (line[position] == '-') ? 0 : (unsigned int)strtoul( line.substr(position, 6).c_str(), NULL, 10 );
+}
+
+bool
+StationCatalog::parseLine(const std::string& line, StationInfo& info)
+{
+    if (line.length() < MINIMUM_STATION_LINE_LENGTH)
+    {
+        return false;
+    }
+
+    info.station_number = (unsigned int)strtoul( line.substr(0, 6).c_str(), NULL, 10 );
+    info.latitude = (float)strtod( line.substr(7, 8).c_str(), NULL );
+    info.longitude = (float)strtod( line.substr(16, 9).c_str(), NULL );
+    info.elevation = (float)strtod( line.substr(26, 6).c_str(), NULL );
+    info.state_code[0] = line[33];
+    info.state_code[1] = line[34];
+    info.state_code[2] = '\0';
+    info.station_name = line.substr(36, 30);
+    info.component_station_numbers[0] = parseComponent(line, 67);
+    info.component_station_numbers[1] = parseComponent(line, 74);
+    info.component_station_numbers[2] = parseComponent(line, 81);
+    info.utc_offset = (int)strtol( line.substr(88, 2).c_str(), NULL, 10 );
+    return true;
+}
+
+bool
+StationCatalog::load(const std::string& file_name)
+{
+    std::ifstream station_file( file_name.c_str() );
+    std::vector<StationInfo> station_vector;
+
+    m_station_vector.clear();
+    m_station_number_vector.clear();
+
+    if ( !station_file.is_open() )
+    {
+        return false;
+    }
+
+    std::string line;
+
+    while ( getline(station_file, line) )
+    {
+        StationInfo info;
+
+        if ( parseLine(line, info) )
+        {
+            station_vector.push_back(info);
+        }
+    }
+
+    // Stable, so the last of any repeated ID is the last of its run
+    std::stable_sort( station_vector.begin(), station_vector.end(), isStationNumberLess );
+
+    for (size_t i = 0; i < station_vector.size(); i++)
+    {
+        if ( i + 1 < station_vector.size() && station_vector[i + 1].station_number == station_vector[i].station_number )
+        {
+            continue;
+        }
+
+        m_station_vector.push_back( station_vector[i] );
+        m_station_number_vector.push_back( station_vector[i].station_number );
+    }
+
+    return true;
+}
+
+size_t
+StationCatalog::findId(unsigned int station_number) const
+{
+    std::vector<unsigned int>::const_iterator number_it = std::lower_bound( m_station_number_vector.begin(), m_station_number_vector.end(), station_number );
+
+    if ( number_it == m_station_number_vector.end() || *number_it != station_number )
+    {
+        return NO_STATION;
+    }
+
+    return size_t( number_it - m_station_number_vector.begin() );
+}
@@ -0,0 +1,81 @@
+//--------------------------------------------------------------------------------------
+// StationCatalog.h
+// Every column of ushcn-stations.txt, one entry per station.
+// http://cdiac.ornl.gov/ftp/ushcn_daily/ushcn-stations.txt
+//
+//   columns  field
+//     1-6    COOP ID
+//     8-15   latitude, degrees north
+//    17-25   longitude, degrees east
+//    27-32   elevation, metres
+//    34-35   state postal code
+//    37-66   station name
+//    68-73   first component COOP ID, ------ if there isn't one
+//    75-80   second component COOP ID
+//    82-87   third component COOP ID
+//    89-90   UTC offset, hours
+//
+// Entries are kept sorted by COOP ID in a flat array, and an entry's index
+// is the station's dense id. Lookups binary search a separate array of the
+// bare IDs, so they neither allocate nor touch the entries they skip.
+
+#ifndef STATION_CATALOG_H_INCLUDED
+#define STATION_CATALOG_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <stddef.h>
+
+static const size_t         NUMBER_OF_COMPONENT_STATIONS = 3;
+
+// One row of the station file
+struct StationInfo
+{
+    unsigned int            station_number;
+    float                   latitude;
+    float                   longitude;
+    float                   elevation;
+    char                    state_code[3];
+    std::string             station_name;
+    unsigned int            component_station_numbers[NUMBER_OF_COMPONENT_STATIONS];
+    int                     utc_offset;
+
+    // The first 15 characters of the name, which is what the reports have
+    // always printed
+    std::string             getShortName() const { return station_name.substr(0, 15); }
+};
+
+class StationCatalog
+{
+public:
+    // Dense id returned for stations that aren't in the catalog
+    static const size_t     NO_STATION = size_t(-1);
+
+    // Read a station file, replacing anything loaded before. Lines too short
+    // to hold every column are skipped, and a later line for the same COOP
+    // ID replaces an earlier one. Returns false if the file can't be opened.
+    bool                    load(const std::string& file_name);
+
+    // Parse one line of the station file, false if it is too short
+    static bool             parseLine(const std::string& line, StationInfo& info);
+
+    size_t                  size() const { return m_station_vector.size(); }
+    bool                    empty() const { return m_station_vector.empty(); }
+    const StationInfo&      operator[](size_t station_id) const { return m_station_vector[station_id]; }
+
+    // Dense id of a COOP ID, NO_STATION if it isn't in the catalog
+    size_t                  findId(unsigned int station_number) const;
+
+    // Entry for a COOP ID, NULL if it isn't in the catalog
+    const StationInfo*      find(unsigned int station_number) const
+                            {
+                                size_t station_id = findId(station_number);
+                                return (station_id == NO_STATION) ? NULL : &m_station_vector[station_id];
+                            }
+
+protected:
+    std::vector<StationInfo> m_station_vector;
+    std::vector<unsigned int> m_station_number_vector;
+};
+
+#endif // STATION_CATALOG_H_INCLUDED
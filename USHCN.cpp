@@ -6,24 +6,49 @@
 // If you modify it and mess it up, don't blame it on me
 
 #include <iostream>
+#include <string.h>
 #include "USHCN.h"
-
-extern size_t most_recent_year;
+#include "ReportWriter.h"
 
 void
 DataRecord::setHighTemperature(unsigned int day_of_month, float value)
 {
-    getDailyHighTemperatureVector()[day_of_month] = value;
+    m_daily_high_temperatures[day_of_month] = value;
 }
 
 void
 DataRecord::setLowTemperature(unsigned int day_of_month, float value)
 {
-    getDailyLowTemperatureVector()[day_of_month] = value;
+    m_daily_low_temperatures[day_of_month] = value;
+}
+
+const char*
+DataRecord::getRecordTypeString()
+{
+    switch ( getRecordType() )
+    {
+        case RECORD_TYPE_TMAX : return "TMAX";
+        case RECORD_TYPE_TMIN : return "TMIN";
+        case RECORD_TYPE_SNOW : return "SNOW";
+        case RECORD_TYPE_SNWD : return "SNWD";
+        case RECORD_TYPE_PRCP : return "PRCP";
+        default : return "";
+    }
+}
+
+DataRecord::RECORD_TYPE
+DataRecord::parseRecordType(const char* element)
+{
+    if ( memcmp(element, "TMAX", 4) == 0 ) return RECORD_TYPE_TMAX;
+    if ( memcmp(element, "TMIN", 4) == 0 ) return RECORD_TYPE_TMIN;
+    if ( memcmp(element, "SNOW", 4) == 0 ) return RECORD_TYPE_SNOW;
+    if ( memcmp(element, "SNWD", 4) == 0 ) return RECORD_TYPE_SNWD;
+    if ( memcmp(element, "PRCP", 4) == 0 ) return RECORD_TYPE_PRCP;
+    return RECORD_TYPE_NONE;
 }
 
-void                    
-DataRecord::parseTemperatureRecord(std::string record_string)
+bool
+DataRecord::parseTemperatureRecord(const char* record, size_t length)
 {
     /*
     Variable        Columns         Type
@@ -41,47 +66,121 @@ DataRecord::parseTemperatureRecord(std::string record_string)
     SFLAG2          32      Character
     */
 
-    size_t position = 0;
+    // The fields are decoded straight out of the line buffer,
+    // nothing here allocates.
+    if (length < MINIMUM_RECORD_LENGTH)
+    {
+        return false;
+    }
+
+    setStationNumber( (unsigned int)parseFixedWidthInteger(record, 6) );
+    setStateNumber( (unsigned int)parseFixedWidthInteger(record, 2) );
+    setYear( (unsigned int)parseFixedWidthInteger(record + 6, 4) );
+    setMonth( (unsigned int)parseFixedWidthInteger(record + 10, 2) );
+    setRecordType( parseRecordType(record + 12) );
 
-    if (record_string.length() < 261)
+    float* temperatures = NULL;
+
+    switch ( getRecordType() )
     {
-        return;
+        case RECORD_TYPE_TMAX : temperatures = getDailyHighTemperatures(); break;
+        case RECORD_TYPE_TMIN : temperatures = getDailyLowTemperatures(); break;
+        default : return true;
     }
 
-    unsigned int station_number = strtoul( record_string.substr(0, 6).c_str(), NULL, 10 );
-    setStationNumber(station_number);
-    unsigned int state_number = strtoul( record_string.substr(0, 2).c_str(), NULL, 10 );
-    setStateNumber(state_number);
-    //std::string state_name = getStateName();
-    unsigned int year = strtoul( record_string.substr(6, 4).c_str(), NULL, 10 );
+    const char* field = record + 16;
 
-    if (year > most_recent_year)
+    for (size_t i = 0; i < MAX_DAYS_IN_MONTH; i++)
     {
-        most_recent_year = year;
+        long value = parseFixedWidthInteger(field, 5);
+        temperatures[i] = (value == -9999) ? UNKNOWN_TEMPERATURE : float(value);
+        field += 8;
     }
 
-    setYear(year);
-    unsigned int month = strtoul( record_string.substr(10, 2).c_str(), NULL, 10 );
-    setMonth(month);
-    std::string record_type = record_string.substr(12, 4);
-    setRecordTypeString(record_type);
+    return true;
+}
 
-    position = 16;
+// Hottest first, ties latest month first
+static bool
+isHotterOrLater(const RankedWindow& a, const RankedWindow& b)
+{
+    return (a.mean != b.mean) ? (a.mean > b.mean) : (a.month_number > b.month_number);
+}
 
-    for (size_t i = 0; i < MAX_DAYS_IN_MONTH; i++)
+// Hottest first, ties earliest month first
+static bool
+isHotterOrEarlier(const RankedWindow& a, const RankedWindow& b)
+{
+    return (a.mean != b.mean) ? (a.mean > b.mean) : (a.month_number < b.month_number);
+}
+
+void
+WindowRanking::rank(size_t top)
+{
+    std::vector<RankedWindow>& window_vector = m_window_vector;
+
+    if (top == 0)
+    {
+        std::sort(window_vector.begin(), window_vector.end(), isHotterOrLater);
+
+        // Keep one entry per mean. A std::map kept the first key it was
+        // given and the last value, so take the earliest window's mean
+        // (it only differs for -0/+0) and the latest window's month.
+        size_t number_kept = 0;
+
+        for (size_t i = 0; i < window_vector.size(); )
+        {
+            size_t j = i + 1;
+
+            while ( j < window_vector.size() && window_vector[j].mean == window_vector[i].mean )
+            {
+                j++;
+            }
+
+            RankedWindow window = { window_vector[j - 1].mean, window_vector[i].month_number };
+            window_vector[number_kept++] = window;
+            i = j;
+        }
+
+        window_vector.resize(number_kept);
+        return;
+    }
+
+    if ( top < window_vector.size() )
     {
-        std::string value_string =  record_string.substr(position, 5);
-        long value = strtol( value_string.c_str(), NULL, 10 );
+        std::nth_element(window_vector.begin(), window_vector.begin() + (top - 1), window_vector.end(), isHotterOrEarlier);
+        float threshold = window_vector[top - 1].mean;
+        size_t number_kept = top;
 
-        if ( getRecordTypeString() == "TMIN" ) 
-        { 
-            getDailyLowTemperatureVector()[i] = (value == -9999) ? UNKNOWN_TEMPERATURE : float(value); 
+        for (size_t i = top; i < window_vector.size(); i++)
+        {
+            if (window_vector[i].mean == threshold)
+            {
+                window_vector[number_kept++] = window_vector[i];
+            }
         }
-        else if ( getRecordTypeString() == "TMAX" ) 
-        { 
-            getDailyHighTemperatureVector()[i] = (value == -9999) ? UNKNOWN_TEMPERATURE : float(value); 
+
+        window_vector.resize(number_kept);
+    }
+
+    std::sort(window_vector.begin(), window_vector.end(), isHotterOrEarlier);
+}
+
+void
+WindowRanking::print(ReportWriter& stream, const char* separator)
+{
+    size_t rank = 0;
+
+    for (size_t i = 0; i < m_window_vector.size(); i++)
+    {
+        if ( i == 0 || m_window_vector[i].mean != m_window_vector[i - 1].mean )
+        {
+            rank = i + 1;
         }
 
-        position += 8;
+        unsigned int year = unsigned( m_window_vector[i].month_number / NUMBER_OF_MONTHS_PER_YEAR );
+        unsigned int month = unsigned( m_window_vector[i].month_number % NUMBER_OF_MONTHS_PER_YEAR );
+
+        stream << rank << separator << month + 1 << separator << year << separator << m_window_vector[i].mean << std::endl;
     }
 }
@@ -12,11 +12,18 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <ostream>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
 
 // Comment out the next two lines to compile on MS compilers
 #include <stdlib.h>
 #include <limits.h>
 
+class ReportWriter;
+
 static const unsigned int   MAX_DAYS_IN_MONTH = 31;
 static const unsigned int   NUMBER_OF_MONTHS_PER_YEAR = 12;
 static const unsigned int   FIRST_YEAR = 1850;
@@ -27,6 +34,7 @@ static const unsigned int   NUMBER_OF_STATES = 48;
 static const float          UNKNOWN_TEMPERATURE = -99.0f;
 static const float          UNREASONABLE_HIGH_TEMPERATURE = 140.0f;
 static const float          UNREASONABLE_LOW_TEMPERATURE = -100.0f;
+static const int16_t        COMPACT_MISSING_TEMPERATURE = INT16_MIN;    // UNKNOWN_TEMPERATURE in compact columns
 static const unsigned int   NUMBER_OF_DAYS_PER_YEAR = 365;
 static const int            NUMBER_OF_MONTHS_UNDER_TEST = 12;
 
@@ -84,6 +92,240 @@ static const char STATE_NAMES[][MAX_STATE_NAME_LENGTH] =
 };
 
 
+// Exact sum of floats, for the yearly and monthly totals. The sum is a 128
+// bit fixed point number with 64 fraction bits, which holds every float from
+// 2^-40 up to 2^62 in magnitude exactly, so adding is integer addition: the
+// result doesn't depend on the order the readings arrive in, or on how they
+// are split between threads, snapshots and deltas. Smaller magnitudes are
+// truncated, the same way every time. Reading the sum rounds it to the
+// nearest float once.
+//
+// The 128 bits are a two's complement pair of 64 bit halves, so no compiler
+// extension is needed for them.
+class ExactSum
+{
+public:
+                            ExactSum() : m_high(0), m_low(0) {}
+
+    ExactSum&               operator+=(float value) { return *this += fromFloat(value); }
+    ExactSum&               operator+=(const ExactSum& other)
+                            {
+                                m_low += other.m_low;
+                                m_high += other.m_high + (m_low < other.m_low);
+                                return *this;
+                            }
+
+    bool                    operator==(const ExactSum& other) const { return m_high == other.m_high && m_low == other.m_low; }
+
+    explicit                operator float() const
+                            {
+                                int exponent;
+                                uint64_t top = getTop(exponent);
+                                return (m_high >> 63) ? -ldexpf(float(top), exponent) : ldexpf(float(top), exponent);
+                            }
+
+    explicit                operator double() const
+                            {
+                                int exponent;
+                                uint64_t top = getTop(exponent);
+                                return (m_high >> 63) ? -ldexp(double(top), exponent) : ldexp(double(top), exponent);
+                            }
+
+private:
+    void                    negate()
+                            {
+                                m_low = ~m_low + 1;
+                                m_high = ~m_high + (m_low == 0);
+                            }
+
+    static ExactSum         fromFloat(float value)
+                            {
+                                uint32_t bits;
+                                memcpy( &bits, &value, sizeof(bits) );
+
+                                // value = mantissa * 2^(exponent - 150), in fixed point
+                                // mantissa * 2^(exponent - 86). Exponents past 2^62 are
+                                // clamped rather than overflowing.
+                                int exponent = int( (bits >> 23) & 0xff );
+                                uint64_t mantissa = bits & 0x7fffff;
+
+                                if (exponent == 0)
+                                {
+                                    exponent = 1;
+                                }
+                                else
+                                {
+                                    mantissa |= 0x800000;
+                                }
+
+                                int shift = std::min(exponent - 86, 102);
+                                ExactSum fixed;
+
+                                if (shift < 0)
+                                {
+                                    fixed.m_low = (shift > -64) ? (mantissa >> -shift) : 0;
+                                }
+                                else if (shift == 0)
+                                {
+                                    fixed.m_low = mantissa;
+                                }
+                                else if (shift < 64)
+                                {
+                                    fixed.m_low = mantissa << shift;
+                                    fixed.m_high = mantissa >> (64 - shift);
+                                }
+                                else
+                                {
+                                    fixed.m_high = mantissa << (shift - 64);
+                                }
+
+                                if (bits >> 31)
+                                {
+                                    fixed.negate();
+                                }
+
+                                return fixed;
+                            }
+
+    // The magnitude as its top 64 bits times 2^exponent. Bits shifted out
+    // are folded into the lowest bit, which is far below where a float or
+    // double rounds, so converting the top bits rounds the same as the full
+    // 128 would.
+    uint64_t                getTop(int& exponent) const
+                            {
+                                ExactSum magnitude = *this;
+
+                                if (m_high >> 63)
+                                {
+                                    magnitude.negate();
+                                }
+
+                                uint64_t high = magnitude.m_high;
+                                uint64_t low = magnitude.m_low;
+                                int shift = 0;
+
+                                while ( shift < 64 && (high >> shift) )
+                                {
+                                    shift++;
+                                }
+
+                                exponent = shift - 64;
+
+                                if (shift == 0)
+                                {
+                                    return low;
+                                }
+
+                                uint64_t top = (shift == 64) ? high : ( (high << (64 - shift)) | (low >> shift) );
+                                uint64_t lost = (shift == 64) ? low : ( low & ( (uint64_t(1) << shift) - 1 ) );
+                                return top | (lost != 0);
+                            }
+
+    uint64_t                m_high;
+    uint64_t                m_low;
+};
+
+// Dense per-year series indexed by year - first year, for accumulators
+// that get hit for every daily reading. Iterate with getFirstYear()
+// through getLastYear() to walk it in year order.
+template <typename T>
+class YearSeries
+{
+public:
+                            YearSeries() : m_first_year(FIRST_YEAR) {}
+                            YearSeries(unsigned int first_year, unsigned int last_year) :
+                                            m_first_year(first_year),
+                                            m_value_vector( (last_year >= first_year) ? (last_year - first_year + 1) : 0, T() )
+                            {
+                            }
+
+    unsigned int            getFirstYear() { return m_first_year; }
+    unsigned int            getLastYear() { return m_first_year + (unsigned int)m_value_vector.size() - 1; }
+    size_t                  size() { return m_value_vector.size(); }
+    bool                    empty() { return m_value_vector.empty(); }
+    bool                    contains(unsigned int year) { return year >= m_first_year && year - m_first_year < m_value_vector.size(); }
+    T&                      operator[](unsigned int year) { return m_value_vector[year - m_first_year]; }
+    T*                      getData() { return m_value_vector.empty() ? NULL : &m_value_vector[0]; }
+
+    void                    add(YearSeries<T>& other)
+                            {
+                                for (size_t i = 0; i < other.size(); i++)
+                                {
+                                    (*this)[ other.getFirstYear() + (unsigned int)i ] += other.m_value_vector[i];
+                                }
+                            }
+
+protected:
+    unsigned int            m_first_year;
+    std::vector<T>          m_value_vector;
+};
+
+// Per month temperature sums and counts for the monthly archives. The year
+// range starts empty and grows to cover whatever years are added, so storage
+// is sized by the data instead of by MAX_YEARS. Years outside 0..MAX_YEARS-1
+// are dropped. Reads outside the range return zero. Sums are ExactSums, so
+// they don't depend on the order the records are read in.
+class MonthlyTotals
+{
+public:
+                            MonthlyTotals() : m_first_year(0), m_number_of_years(0) {}
+
+    unsigned int            getFirstYear() { return m_first_year; }
+    unsigned int            getLastYear() { return m_first_year + (unsigned int)m_number_of_years - 1; }
+    size_t                  getNumberOfYears() { return m_number_of_years; }
+    bool                    empty() { return m_number_of_years == 0; }
+    bool                    contains(unsigned int year) { return year >= m_first_year && year - m_first_year < m_number_of_years; }
+    unsigned int            getCount(unsigned int year, size_t month) { return contains(year) ? m_count_vector[ getIndex(year, month) ] : 0; }
+
+    float                   getSum(unsigned int year, size_t month) { return contains(year) ? float( m_sum_vector[ getIndex(year, month) ] ) : 0.0f; }
+
+    void                    add(unsigned int year, size_t month, float temperature)
+                            {
+                                if ( year >= MAX_YEARS )
+                                {
+                                    return;
+                                }
+
+                                if ( !contains(year) )
+                                {
+                                    extend(year);
+                                }
+
+                                m_sum_vector[ getIndex(year, month) ] += temperature;
+                                m_count_vector[ getIndex(year, month) ]++;
+                            }
+
+protected:
+    size_t                  getIndex(unsigned int year, size_t month) { return (year - m_first_year) * NUMBER_OF_MONTHS_PER_YEAR + month; }
+
+    // Widen the range to take in year. Only a year before the current
+    // first year moves the existing data.
+    void                    extend(unsigned int year)
+                            {
+                                unsigned int first_year = ( empty() || year < m_first_year ) ? year : m_first_year;
+                                unsigned int last_year = ( empty() || year > getLastYear() ) ? year : getLastYear();
+                                size_t shift = empty() ? 0 : (m_first_year - first_year) * NUMBER_OF_MONTHS_PER_YEAR;
+
+                                m_number_of_years = last_year - first_year + 1;
+                                m_first_year = first_year;
+                                m_sum_vector.resize( m_number_of_years * NUMBER_OF_MONTHS_PER_YEAR, ExactSum() );
+                                m_count_vector.resize( m_number_of_years * NUMBER_OF_MONTHS_PER_YEAR, 0 );
+
+                                if (shift)
+                                {
+                                    std::copy_backward( m_sum_vector.begin(), m_sum_vector.end() - shift, m_sum_vector.end() );
+                                    std::copy_backward( m_count_vector.begin(), m_count_vector.end() - shift, m_count_vector.end() );
+                                    std::fill( m_sum_vector.begin(), m_sum_vector.begin() + shift, ExactSum() );
+                                    std::fill( m_count_vector.begin(), m_count_vector.begin() + shift, 0 );
+                                }
+                            }
+
+    unsigned int            m_first_year;
+    size_t                  m_number_of_years;
+    std::vector<ExactSum>   m_sum_vector;
+    std::vector<unsigned int> m_count_vector;
+};
+
 class DataRecord 
 {
 public:
@@ -97,10 +339,17 @@ public:
         RECORD_TYPE_NONE
     };
 
-                            DataRecord() : 
-                                            m_daily_high_temperature_vector(MAX_DAYS_IN_MONTH),
-                                            m_daily_low_temperature_vector(MAX_DAYS_IN_MONTH)
+    // Daily records shorter than this are truncated and get skipped
+    static const size_t     MINIMUM_RECORD_LENGTH = 261;
+
+                            DataRecord()
                             {
+                                setStationNumber(0);
+                                setRecordType(RECORD_TYPE_NONE);
+                                setStateNumber(0);
+                                setYear(0);
+                                setMonth(0);
+
                                 for (size_t i = 0; i < MAX_DAYS_IN_MONTH; i++)
                                 {
                                     setHighTemperature(i, UNKNOWN_TEMPERATURE);
@@ -110,8 +359,9 @@ public:
 
     unsigned int            getStationNumber() { return m_station_number; }
     void                    setStationNumber(unsigned int value) { m_station_number = value; }
-    std::string&            getRecordTypeString() { return m_record_type_string; }
-    void                    setRecordTypeString(std::string type) { m_record_type_string = type; }
+    RECORD_TYPE             getRecordType() { return m_record_type; }
+    void                    setRecordType(RECORD_TYPE type) { m_record_type = type; }
+    const char*             getRecordTypeString();
     unsigned int            getStateNumber() { return m_state_number; }
     void                    setStateNumber(unsigned int value) { m_state_number = value; }
     std::string             getStateName() { return std::string( STATE_NAMES[ getStateNumber() ] ); }
@@ -119,61 +369,210 @@ public:
     void                    setYear(unsigned int value) { m_year = value; }
     unsigned int            getMonth() { return m_month; }
     void                    setMonth(unsigned int value) { m_month = value; }
-    std::vector<float>&     getDailyHighTemperatureVector() { return m_daily_high_temperature_vector; }
-    float                   getHighTemperature(unsigned int day_of_month) { return getDailyHighTemperatureVector().at(day_of_month); }
+    float*                  getDailyHighTemperatures() { return m_daily_high_temperatures; }
+    float                   getHighTemperature(unsigned int day_of_month) { return m_daily_high_temperatures[day_of_month]; }
     void                    setHighTemperature(unsigned int day_of_month, float value);
-    std::vector<float>&     getDailyLowTemperatureVector() { return m_daily_high_temperature_vector; }
-    float                   getLowTemperature(unsigned int day_of_month) { return getDailyLowTemperatureVector().at(day_of_month); }
+    float*                  getDailyLowTemperatures() { return m_daily_low_temperatures; }
+    float                   getLowTemperature(unsigned int day_of_month) { return m_daily_low_temperatures[day_of_month]; }
     void                    setLowTemperature(unsigned int day_of_month, float value);
 
 
-    void                    parseTemperatureRecord(std::string record_string);
+    bool                    parseTemperatureRecord(const char* record, size_t length);
+    bool                    parseTemperatureRecord(const std::string& record_string) { return parseTemperatureRecord( record_string.data(), record_string.length() ); }
+
+    static RECORD_TYPE      parseRecordType(const char* element);
 
 
 protected:
     unsigned int            m_station_number;
-    std::string             m_record_type_string;
+    RECORD_TYPE             m_record_type;
     unsigned int            m_state_number;
     unsigned int            m_year;
     unsigned int            m_month;
-    std::vector<float>      m_daily_high_temperature_vector;
-    std::vector<float>      m_daily_low_temperature_vector;
+    float                   m_daily_high_temperatures[MAX_DAYS_IN_MONTH];
+    float                   m_daily_low_temperatures[MAX_DAYS_IN_MONTH];
 };
 
-class Day
+// Decode a fixed width decimal field in place, the way strtol() would:
+// leading blanks, an optional sign, then digits up to the first non digit.
+inline long
+parseFixedWidthInteger(const char* field, size_t width)
+{
+    const char* end = field + width;
+
+    while ( field < end && *field == ' ' )
+    {
+        field++;
+    }
+
+    bool negative = false;
+
+    if ( field < end && ( *field == '-' || *field == '+' ) )
+    {
+        negative = (*field == '-');
+        field++;
+    }
+
+    long value = 0;
+
+    for ( ; field < end && unsigned(*field - '0') < 10; field++)
+    {
+        value = (value * 10) + (*field - '0');
+    }
+
+    return negative ? -value : value;
+}
+
+// Column store for one station's daily readings. Slots are laid out year major
+// with 31 slots per month, in the same order as the station's year vector,
+// so slot = (year_index * 12 + month) * 31 + day and every month is one
+// contiguous block. Missing readings hold UNKNOWN_TEMPERATURE.
+//
+// Compact columns keep the readings as the whole degrees they arrive as, in
+// int16_t with COMPACT_MISSING_TEMPERATURE for missing ones, at half the
+// size. Only one pair of columns is in use, picked by setCompact() while the
+// columns are still empty.
+class DailyColumns
 {
 public:
-                            Day()
+    static const size_t     SLOTS_PER_YEAR = NUMBER_OF_MONTHS_PER_YEAR * MAX_DAYS_IN_MONTH;
+
+                            DailyColumns() : m_number_of_years(0), m_compact(false) {}
+
+    size_t                  getNumberOfYears() { return m_number_of_years; }
+    size_t                  getNumberOfSlots() { return m_number_of_years * SLOTS_PER_YEAR; }
+    static size_t           getSlot(size_t year_index, size_t month, size_t day) { return ( (year_index * NUMBER_OF_MONTHS_PER_YEAR) + month ) * MAX_DAYS_IN_MONTH + day; }
+    bool                    isCompact() { return m_compact; }
+    void                    setCompact(bool flag) { if (m_number_of_years == 0) { m_compact = flag; } }
+
+    float*                  getMaxTemperatures() { return m_max_temperature_vector.empty() ? NULL : &m_max_temperature_vector[0]; }
+    float*                  getMinTemperatures() { return m_min_temperature_vector.empty() ? NULL : &m_min_temperature_vector[0]; }
+    float*                  getMaxTemperatures(size_t year_index, size_t month) { return &m_max_temperature_vector[ getSlot(year_index, month, 0) ]; }
+    float*                  getMinTemperatures(size_t year_index, size_t month) { return &m_min_temperature_vector[ getSlot(year_index, month, 0) ]; }
+    int16_t*                getCompactMaxTemperatures() { return m_compact_max_temperature_vector.empty() ? NULL : &m_compact_max_temperature_vector[0]; }
+    int16_t*                getCompactMinTemperatures() { return m_compact_min_temperature_vector.empty() ? NULL : &m_compact_min_temperature_vector[0]; }
+    int16_t*                getCompactMaxTemperatures(size_t year_index, size_t month) { return &m_compact_max_temperature_vector[ getSlot(year_index, month, 0) ]; }
+    int16_t*                getCompactMinTemperatures(size_t year_index, size_t month) { return &m_compact_min_temperature_vector[ getSlot(year_index, month, 0) ]; }
+
+    // The columns in use as raw bytes, getTemperatureSize() bytes a slot
+    size_t                  getTemperatureSize() { return m_compact ? sizeof(int16_t) : sizeof(float); }
+    void*                   getMaxTemperatureData() { return m_compact ? (void*)getCompactMaxTemperatures() : (void*)getMaxTemperatures(); }
+    void*                   getMinTemperatureData() { return m_compact ? (void*)getCompactMinTemperatures() : (void*)getMinTemperatures(); }
+
+    static float            expandCompactTemperature(int16_t value) { return (value == COMPACT_MISSING_TEMPERATURE) ? UNKNOWN_TEMPERATURE : float(value); }
+
+    // One reading, UNKNOWN_TEMPERATURE if it is missing, whichever columns are in use
+    float                   getMaxTemperature(size_t slot) { return m_compact ? expandCompactTemperature( m_compact_max_temperature_vector[slot] ) : m_max_temperature_vector[slot]; }
+    float                   getMinTemperature(size_t slot) { return m_compact ? expandCompactTemperature( m_compact_min_temperature_vector[slot] ) : m_min_temperature_vector[slot]; }
+
+    // Readings are whole degrees between the UNREASONABLE_* limits, so they
+    // fit compact columns exactly
+    void                    setMaxTemperature(size_t slot, float value)
+                            {
+                                if (m_compact)
+                                {
+                                    m_compact_max_temperature_vector[slot] = int16_t(value);
+                                }
+                                else
+                                {
+                                    m_max_temperature_vector[slot] = value;
+                                }
+                            }
+
+    void                    setMinTemperature(size_t slot, float value)
+                            {
+                                if (m_compact)
+                                {
+                                    m_compact_min_temperature_vector[slot] = int16_t(value);
+                                }
+                                else
+                                {
+                                    m_min_temperature_vector[slot] = value;
+                                }
+                            }
+
+    // Append an empty year, matching a push_back onto the station's year vector
+    void                    addYear()
+                            {
+                                m_number_of_years++;
+                                resizeColumns(false);
+                            }
+
+    // Make room for number_of_years without reallocating
+    void                    reserve(size_t number_of_years)
                             {
-                                setMaxTemperature( UNKNOWN_TEMPERATURE );
-                                setMinTemperature( UNKNOWN_TEMPERATURE );
+                                size_t number_of_slots = number_of_years * SLOTS_PER_YEAR;
+
+                                if (m_compact)
+                                {
+                                    m_compact_max_temperature_vector.reserve(number_of_slots);
+                                    m_compact_min_temperature_vector.reserve(number_of_slots);
+                                }
+                                else
+                                {
+                                    m_max_temperature_vector.reserve(number_of_slots);
+                                    m_min_temperature_vector.reserve(number_of_slots);
+                                }
                             }
 
-    float                   getMaxTemperature() { return m_max_temperature; }
-    void                    setMaxTemperature(float value) { m_max_temperature = value; }
-    float                   getMinTemperature() { return m_min_temperature; }
-    void                    setMinTemperature(float value) { m_min_temperature = value; }
+    // Size the columns for number_of_years, every slot missing
+    void                    resize(size_t number_of_years)
+                            {
+                                m_number_of_years = number_of_years;
+                                resizeColumns(true);
+                            }
 
 protected:
-    float                   m_max_temperature;
-    float                   m_min_temperature;
+
+    // Grow (or with clear, refill) the columns in use to getNumberOfSlots()
+    void                    resizeColumns(bool clear)
+                            {
+                                size_t number_of_slots = getNumberOfSlots();
+
+                                if (clear)
+                                {
+                                    m_max_temperature_vector.clear();
+                                    m_min_temperature_vector.clear();
+                                    m_compact_max_temperature_vector.clear();
+                                    m_compact_min_temperature_vector.clear();
+                                }
+
+                                if (m_compact)
+                                {
+                                    m_compact_max_temperature_vector.resize(number_of_slots, COMPACT_MISSING_TEMPERATURE);
+                                    m_compact_min_temperature_vector.resize(number_of_slots, COMPACT_MISSING_TEMPERATURE);
+                                }
+                                else
+                                {
+                                    m_max_temperature_vector.resize(number_of_slots, UNKNOWN_TEMPERATURE);
+                                    m_min_temperature_vector.resize(number_of_slots, UNKNOWN_TEMPERATURE);
+                                }
+                            }
+
+    size_t                  m_number_of_years;
+    bool                    m_compact;
+    std::vector<float>      m_max_temperature_vector;
+    std::vector<float>      m_min_temperature_vector;
+    std::vector<int16_t>    m_compact_max_temperature_vector;
+    std::vector<int16_t>    m_compact_min_temperature_vector;
 };
 
 class Month
 {
 public:
-                            Month() : m_day_vector(MAX_DAYS_IN_MONTH)
+                            Month()
                             {
                                 setRecordMaxTemperature( float(INT_MIN) );
                                 setRecordMinTemperature( float(INT_MAX) );
                                 setRecordMaxDay(0);
                                 setRecordMinDay(0);
                                 setValid(false);
+                                setTotalTemperature(0);
+                                setNumberOfTemperatures(0);
                             }
 
     bool                    getValid() { return m_valid; }
     void                    setValid(bool flag) { m_valid = flag; }
-    std::vector<Day>&       getDayVector() { return m_day_vector; }
     float                   getRecordMaxTemperature() { return m_record_max_temperature; }
     void                    setRecordMaxTemperature(float value) { m_record_max_temperature = value; }
     float                   getRecordMinTemperature() { return m_record_min_temperature; }
@@ -191,7 +590,6 @@ public:
 
 protected:
     bool                    m_valid;
-    std::vector<Day>        m_day_vector;
     float                   m_record_max_temperature;
     float                   m_record_min_temperature;
     unsigned int            m_record_max_day;
@@ -200,18 +598,23 @@ protected:
     unsigned int            m_number_of_temperatures;
 };
 
+// A year's months are held inline, so a Year is one flat block that costs
+// no allocations of its own and copies with a memcpy
 class Year
 {
 public:
-                            Year() : m_month_vector(NUMBER_OF_MONTHS_PER_YEAR)
+                            Year()
                             {
                                 setRecordMaxTemperature( float(INT_MIN) );
                                 setRecordMinTemperature( float(INT_MAX) );
                                 setRecordMaxMonth(0);
                                 setRecordMinMonth(0);
+                                setYear(0);
+                                setTotalTemperature(0);
+                                setNumberOfTemperatures(0);
                             }
 
-    std::vector<Month>&     getMonthVector() { return m_month_vector; }
+    Month&                  getMonth(size_t month) { return m_months[month]; }
     unsigned int            getYear() { return m_year; }
     void                    setYear(unsigned int value) { m_year = value; }
     float                   getRecordMaxTemperature() { return m_record_max_temperature; }
@@ -230,7 +633,7 @@ public:
     void                    incrementNumberOfTemperatures() { m_number_of_temperatures++; }
 
 protected:
-    std::vector<Month>      m_month_vector;
+    Month                   m_months[NUMBER_OF_MONTHS_PER_YEAR];
     unsigned int            m_year;
     float                   m_record_max_temperature;
     float                   m_record_min_temperature;
@@ -240,18 +643,32 @@ protected:
     unsigned int            m_number_of_temperatures;
 };
 
+// Stations and states own all of their years' storage, so they can only be
+// moved. Building one in place and moving it about never copies its data,
+// and an accidental copy doesn't compile.
 class Station
 {
 public:
                             Station() 
                             {
+                                setStationNumber(0);
                                 setRecordMaxTemperature( float(INT_MIN) );
                                 setRecordMinTemperature( float(INT_MAX) );
                                 setRecordMaxYear(0);
                                 setRecordMinYear(0);
                             }
 
-                            std::vector<Year>&      getYearVector() { return m_year_vector; }
+                            Station(Station&&) = default;
+    Station&                operator=(Station&&) = default;
+                            Station(const Station&) = delete;
+    Station&                operator=(const Station&) = delete;
+
+    std::vector<Year>&      getYearVector() { return m_year_vector; }
+    DailyColumns&           getDailyColumns() { return m_daily_columns; }
+    void                    addYear(const Year& year) { m_year_vector.push_back(year); m_daily_columns.addYear(); }
+
+    // Make room for number_of_years without reallocating as they are added
+    void                    reserveYears(size_t number_of_years) { m_year_vector.reserve(number_of_years); m_daily_columns.reserve(number_of_years); }
     unsigned int            getStationNumber() { return m_station_number; }
     void                    setStationNumber(unsigned int value) { m_station_number = value; }
     std::string&            getStationName() { return m_station_name; }
@@ -269,6 +686,7 @@ public:
 
 protected:
     std::vector<Year>       m_year_vector;
+    DailyColumns            m_daily_columns;
     unsigned int            m_station_number;
     std::string             m_station_name;
     std::string             m_state_name;
@@ -283,12 +701,18 @@ class State
 public:
                             State() 
                             {
+                                setStateNumber(0);
                                 setRecordMaxTemperature( float(INT_MIN) );
                                 setRecordMinTemperature( float(INT_MAX) );
                                 setRecordMaxYear(0);
                                 setRecordMinYear(0);
                             }
 
+                            State(State&&) = default;
+    State&                  operator=(State&&) = default;
+                            State(const State&) = delete;
+    State&                  operator=(const State&) = delete;
+
     std::vector<Station>&   getStationVector() { return m_station_vector; }
     unsigned int            getStateNumber() { return m_state_number; }
     void                    setStateNumber(unsigned int value) { m_state_number = value; }
@@ -311,6 +735,47 @@ protected:
     unsigned int            m_record_min_year;
 };
 
+// One rolling window mean and the month it ends on (year * 12 + month)
+struct RankedWindow
+{
+    float                   mean;
+    size_t                  month_number;
+};
+
+// Leaderboard of rolling window means, hottest first. Windows go into a flat
+// vector as they are computed and are only ordered once, by rank().
+class WindowRanking
+{
+public:
+    size_t                  size() { return m_window_vector.size(); }
+    RankedWindow&           operator[](size_t i) { return m_window_vector[i]; }
+    void                    clear() { m_window_vector.clear(); }
+    void                    reserve(size_t number_of_windows) { m_window_vector.reserve(number_of_windows); }
+
+    // Windows must be added in month order. NaN means are dropped.
+    void                    add(float mean, size_t month_number)
+                            {
+                                if (mean == mean)
+                                {
+                                    RankedWindow window = { mean, month_number };
+                                    m_window_vector.push_back(window);
+                                }
+                            }
+
+    // Sort hottest first. With top == 0 equal means collapse into one entry
+    // holding the latest month, like the std::map leaderboards this replaces.
+    // Otherwise only the top windows are kept, plus any that tie the last
+    // one, with ties kept and listed in month order. That costs O(n) to
+    // select and O(top log top) to sort.
+    void                    rank(size_t top);
+
+    // "Rank, Month, Year, Temperature" rows. Tied windows share a rank.
+    void                    print(ReportWriter& stream, const char* separator);
+
+protected:
+    std::vector<RankedWindow> m_window_vector;
+};
+
 class Country
 {
 public:
@@ -320,12 +785,14 @@ public:
                                 setRecordMinTemperature( float(INT_MAX) );
                                 setRecordMaxYear(0);
                                 setRecordMinYear(0);
+                                setCompactStorage(false);
                             }
 
-    std::map<float,size_t>& getVariableMonthMeanAverageMap() { return m_variable_month_mean_average_map; }
-    std::map<float,size_t>& getVariableMonthMeanMaximumMap() { return m_variable_month_mean_maximum_map; }
-    std::map<float,size_t>& getVariableMonthMeanMinimumMap() { return m_variable_month_mean_minimum_map; }
     std::vector<State>&     getStateVector() { return m_state_vector; }
+
+    // Whether stations added from now on keep their readings in compact columns
+    bool                    getCompactStorage() { return m_compact_storage; }
+    void                    setCompactStorage(bool flag) { m_compact_storage = flag; }
     float                   getRecordMaxTemperature() { return m_record_max_temperature; }
     void                    setRecordMaxTemperature(float value) { m_record_max_temperature = value; }
     float                   getRecordMinTemperature() { return m_record_min_temperature; }
@@ -336,14 +803,12 @@ public:
     void                    setRecordMinYear(unsigned int value) { m_record_min_year = value; }
 
 protected:
-    std::map<float,size_t>  m_variable_month_mean_average_map;
-    std::map<float,size_t>  m_variable_month_mean_maximum_map;
-    std::map<float,size_t>  m_variable_month_mean_minimum_map;
     std::vector<State>      m_state_vector;
     float                   m_record_max_temperature;
     float                   m_record_min_temperature;
     unsigned int            m_record_max_year;
     unsigned int            m_record_min_year;
+    bool                    m_compact_storage;
 };
 
 #endif // USHCN_H_INCLUDED